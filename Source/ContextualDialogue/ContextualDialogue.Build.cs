@@ -26,6 +26,7 @@ public class ContextualDialogue : ModuleRules
 			new string[]
 			{
 				"Core",
+				"GameplayTags",
 				// ... add other public dependencies that you statically link with here ...
 			}
 			);
@@ -0,0 +1,47 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "AsyncDialogueQuery.h"
+
+#include "DialogueManagerSubsystem.h"
+#include "Kismet/GameplayStatics.h"
+
+UAsyncDialogueQuery* UAsyncDialogueQuery::GetLinesForCurrentContextAsync(
+	UObject* WorldContextObject,
+	const int NoLines,
+	const TArray<FQueryCategory>& QueryCategories,
+	const TMap<FString, FString>& RequiredParameters,
+	const TMap<FString, FString>& ExcludedParameters,
+	bool ProcessCallbacks)
+{
+	UAsyncDialogueQuery* Action = NewObject<UAsyncDialogueQuery>();
+	Action->WorldContext = WorldContextObject;
+	Action->NumLines = NoLines;
+	Action->Categories = QueryCategories;
+	Action->Required = RequiredParameters;
+	Action->Excluded = ExcludedParameters;
+	Action->bProcessCallbacks = ProcessCallbacks;
+	Action->RegisterWithGameInstance(WorldContextObject);
+	return Action;
+}
+
+void UAsyncDialogueQuery::Activate()
+{
+	const UGameInstance* GameInstance = UGameplayStatics::GetGameInstance(WorldContext);
+	UDialogueManagerSubsystem* MySubsystem = GameInstance ? GameInstance->GetSubsystem<UDialogueManagerSubsystem>() : nullptr;
+
+	// No subsystem, no lines - still fire the pin so the graph does not hang
+	if (!MySubsystem)
+	{
+		HandleQueryCompleted(TArray<UContextualDialogueLine*>());
+		return;
+	}
+
+	MySubsystem->GetLinesForCurrentContextAsync(NumLines, Categories, Required, Excluded, bProcessCallbacks,
+		FOnDialogueAsyncQueryCompleted::CreateUObject(this, &UAsyncDialogueQuery::HandleQueryCompleted));
+}
+
+void UAsyncDialogueQuery::HandleQueryCompleted(const TArray<UContextualDialogueLine*>& Lines)
+{
+	Completed.Broadcast(Lines, Lines.Num() == NumLines);
+	SetReadyToDestroy();
+}
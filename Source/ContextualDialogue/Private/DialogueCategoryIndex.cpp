@@ -0,0 +1,218 @@
+#include "DialogueCategoryIndex.h"
+
+void FDialogueCategoryIndex::Reset()
+{
+	CategoryIds.Empty();
+	TagIds.Empty();
+	Postings.Empty();
+	LineCategories.Empty();
+}
+
+void FDialogueCategoryIndex::AddLine(const int32 LineIdx, const FString& Name, const FString& Value)
+{
+	check(LineIdx != INDEX_NONE);
+
+	TMap<FString, int32>& Values = CategoryIds.FindOrAdd(Name);
+	int32 CategoryId;
+	if (const int32* Existing = Values.Find(Value))
+	{
+		CategoryId = *Existing;
+	}
+	else
+	{
+		CategoryId = Postings.AddDefaulted();
+		Values.Add(Value, CategoryId);
+	}
+
+	AddLineToCategory(LineIdx, CategoryId);
+}
+
+void FDialogueCategoryIndex::AddLineTag(const int32 LineIdx, const FGameplayTag& Tag)
+{
+	check(LineIdx != INDEX_NONE);
+	if (!Tag.IsValid())
+		return;
+
+	// The tag itself is part of its parents container
+	for (const FGameplayTag& ParentTag : Tag.GetGameplayTagParents())
+	{
+		int32 CategoryId;
+		if (const int32* Existing = TagIds.Find(ParentTag))
+		{
+			CategoryId = *Existing;
+		}
+		else
+		{
+			CategoryId = Postings.AddDefaulted();
+			TagIds.Add(ParentTag, CategoryId);
+		}
+
+		AddLineToCategory(LineIdx, CategoryId);
+	}
+}
+
+void FDialogueCategoryIndex::AddLineToCategory(const int32 LineIdx, const int32 CategoryId)
+{
+	if (LineIdx >= LineCategories.Num())
+		LineCategories.SetNum(LineIdx + 1);
+
+	LineCategories[LineIdx].AddUnique(CategoryId);
+	FDialoguePostingListUtils::Insert(Postings[CategoryId], LineIdx);
+}
+
+void FDialogueCategoryIndex::RemoveLine(const int32 LineIdx)
+{
+	if (!LineCategories.IsValidIndex(LineIdx))
+		return;
+
+	for (const int32 CategoryId : LineCategories[LineIdx])
+		FDialoguePostingListUtils::Remove(Postings[CategoryId], LineIdx);
+
+	LineCategories[LineIdx].Empty();
+}
+
+const FDialoguePostingList* FDialogueCategoryIndex::Find(const FString& Name, const FString& Value) const
+{
+	const TMap<FString, int32>* Values = CategoryIds.Find(Name);
+	const int32* CategoryId = Values ? Values->Find(Value) : nullptr;
+	return CategoryId ? &Postings[*CategoryId] : nullptr;
+}
+
+const FDialoguePostingList* FDialogueCategoryIndex::Find(const FQueryCategory& Category) const
+{
+	const int32 CategoryId = FindCategoryId(Category);
+	return CategoryId != INDEX_NONE ? &Postings[CategoryId] : nullptr;
+}
+
+int32 FDialogueCategoryIndex::FindCategoryId(const FQueryCategory& Category) const
+{
+	if (Category.CategoryTag.IsValid())
+	{
+		const int32* CategoryId = TagIds.Find(Category.CategoryTag);
+		return CategoryId ? *CategoryId : INDEX_NONE;
+	}
+
+	const TMap<FString, int32>* Values = CategoryIds.Find(Category.CategoryName);
+	const int32* CategoryId = Values ? Values->Find(Category.CategoryValue) : nullptr;
+	return CategoryId ? *CategoryId : INDEX_NONE;
+}
+
+void FDialogueCategoryIndex::FindIds(const TArray<FQueryCategory>& QueryCategories, FDialogueCategoryIds& OutIds) const
+{
+	OutIds.Reset();
+	for (const FQueryCategory& Category : QueryCategories)
+		OutIds.AddUnique(FindCategoryId(Category));
+}
+
+int32 FDialogueCategoryIndex::Estimate(const TArray<FQueryCategory>& QueryCategories, const EDialogueCategoryMatch Match,
+                                       const int32 NumLines, int32& OutListCost) const
+{
+	OutListCost = 0;
+	int32 Total = 0;
+	int32 Shortest = NumLines;
+
+	for (const FQueryCategory& Category : QueryCategories)
+	{
+		const FDialoguePostingList* List = Find(Category);
+		const int32 Length = List ? List->Num() : 0;
+		Total += Length;
+		Shortest = FMath::Min(Shortest, Length);
+		OutListCost += Length;
+	}
+
+	// Any-of can't match more than all the lists together, all-of can't match more than the shortest one
+	return Match == EDialogueCategoryMatch::AllOf ? Shortest : FMath::Min(Total, NumLines);
+}
+
+bool FDialogueCategoryIndex::Matches(const int32 LineIdx, const FDialogueCategoryIds& Ids, const EDialogueCategoryMatch Match) const
+{
+	static const TArray<int32, TInlineAllocator<4>> NoCategories;
+	const TArray<int32, TInlineAllocator<4>>& Categories = LineCategories.IsValidIndex(LineIdx) ? LineCategories[LineIdx] : NoCategories;
+
+	for (const int32 CategoryId : Ids)
+	{
+		const bool bBelongs = CategoryId != INDEX_NONE && Categories.Contains(CategoryId);
+		if (Match == EDialogueCategoryMatch::AnyOf && bBelongs)
+			return true;
+		if (Match == EDialogueCategoryMatch::AllOf && !bBelongs)
+			return false;
+	}
+
+	return Match == EDialogueCategoryMatch::AllOf;
+}
+
+bool FDialogueCategoryIndex::GatherLists(const TArray<FQueryCategory>& QueryCategories, const EDialogueCategoryMatch Match,
+                                         TArray<const FDialoguePostingList*, TInlineAllocator<8>>& OutLists) const
+{
+	OutLists.Reset();
+	for (const FQueryCategory& Category : QueryCategories)
+	{
+		const FDialoguePostingList* List = Find(Category);
+		if (!List || List->Num() == 0)
+		{
+			// A single empty category means no line belongs to all of them, while any-of just skips it
+			if (Match == EDialogueCategoryMatch::AllOf)
+				return false;
+			continue;
+		}
+
+		// The same category requested twice is still resolved once
+		OutLists.AddUnique(List);
+	}
+
+	// Shortest first, so that the intermediate results of intersections stay as small as possible
+	OutLists.Sort([](const FDialoguePostingList& A, const FDialoguePostingList& B) { return A.Num() < B.Num(); });
+	return OutLists.Num() > 0;
+}
+
+void FDialogueCategoryIndex::Resolve(const TArray<FQueryCategory>& QueryCategories, const EDialogueCategoryMatch Match,
+                                     FDialoguePostingList& OutLines) const
+{
+	check(QueryCategories.Num() > 0);
+	OutLines.Reset();
+
+	TArray<const FDialoguePostingList*, TInlineAllocator<8>> Lists;
+	if (!GatherLists(QueryCategories, Match, Lists))
+		return;
+
+	OutLines.Append(*Lists[0]);
+	FDialoguePostingList& Scratch = ResolveScratch;
+	for (int32 ListIdx = 1; ListIdx < Lists.Num(); ListIdx++)
+	{
+		if (Match == EDialogueCategoryMatch::AllOf)
+		{
+			if (OutLines.Num() == 0)
+				return;
+
+			FDialoguePostingListUtils::Intersect(OutLines, *Lists[ListIdx], Scratch);
+		}
+		else
+		{
+			FDialoguePostingListUtils::Union(OutLines, *Lists[ListIdx], Scratch);
+		}
+		Swap(OutLines, Scratch);
+	}
+}
+
+void FDialogueCategoryIndex::BuildMask(const TArray<FQueryCategory>& QueryCategories, const EDialogueCategoryMatch Match,
+                                       const int32 NumLines, FDialogueBitSet& OutMask) const
+{
+	OutMask.Init(NumLines, false);
+
+	if (Match == EDialogueCategoryMatch::AllOf)
+	{
+		Resolve(QueryCategories, Match, MaskScratch);
+		for (const int32 LineIdx : MaskScratch)
+			OutMask.Set(LineIdx);
+		return;
+	}
+
+	// Setting a bit twice is harmless, so any-of doesn't even need the union
+	TArray<const FDialoguePostingList*, TInlineAllocator<8>> Lists;
+	GatherLists(QueryCategories, Match, Lists);
+	for (const FDialoguePostingList* List : Lists)
+	{
+		for (const int32 LineIdx : *List)
+			OutMask.Set(LineIdx);
+	}
+}
@@ -0,0 +1,180 @@
+#include "DialogueClassDescriptor.h"
+
+#include "DialogueContextComponent.h"
+#include "GameplayTagContainer.h"
+
+/** Descriptors are heap allocated so that references handed out stay valid while the map grows */
+static TMap<const UClass*, TUniquePtr<FDialogueClassDescriptor>> Descriptors;
+
+const FDialogueClassDescriptor& FDialogueClassDescriptor::Get(const UClass* Class)
+{
+	check(IsInGameThread());
+	check(Class);
+
+	// A recompiled Blueprint keeps its class object but gets new properties and functions, and a hot reload replaces
+	// native ones. Either way every cached pointer may be stale, so the whole cache goes
+	static bool bInvalidationBound = false;
+	if (!bInvalidationBound)
+	{
+		FCoreUObjectDelegates::OnObjectsReinstanced.AddStatic([](const TMap<UObject*, UObject*>&) { Invalidate(); });
+		FCoreUObjectDelegates::ReloadCompleteDelegate.AddStatic([](EReloadCompleteReason) { Invalidate(); });
+		bInvalidationBound = true;
+	}
+
+	TUniquePtr<FDialogueClassDescriptor>& Descriptor = Descriptors.FindOrAdd(Class);
+	if (!Descriptor.IsValid() || Descriptor->SourceClass.Get() != Class)
+	{
+		// Either a new class or a new class at the address of one that has been garbage collected
+		Descriptor = MakeUnique<FDialogueClassDescriptor>();
+		Descriptor->Build(Class);
+	}
+
+	return *Descriptor;
+}
+
+void FDialogueClassDescriptor::Invalidate()
+{
+	check(IsInGameThread());
+	Descriptors.Empty();
+}
+
+void FDialogueClassDescriptor::Build(const UClass* Class)
+{
+	SourceClass = Class;
+
+	// We rely on the variable names being prefixed with "DSS_", the prefix is removed from the registered names
+	for (TFieldIterator<FIntProperty> PropIt(Class); PropIt; ++PropIt)
+	{
+		if (PropIt->GetName().Contains("DSS_"))
+			IntProperties.Add(PropIt->GetName().Replace(TEXT("DSS_"), TEXT("")), *PropIt);
+	}
+
+	for (TFieldIterator<FStrProperty> PropIt(Class); PropIt; ++PropIt)
+	{
+		if (PropIt->GetName().Contains("DSS_"))
+			StrProperties.Add(PropIt->GetName().Replace(TEXT("DSS_"), TEXT("")), *PropIt);
+	}
+
+	for (TFieldIterator<FBoolProperty> PropIt(Class); PropIt; ++PropIt)
+	{
+		if (PropIt->GetName().Contains("DSS_"))
+			BoolProperties.Add(PropIt->GetName().Replace(TEXT("DSS_"), TEXT("")), *PropIt);
+	}
+
+	// Blueprint floats are doubles since UE5, both are welcome
+	for (TFieldIterator<FNumericProperty> PropIt(Class); PropIt; ++PropIt)
+	{
+		if (PropIt->IsFloatingPoint() && PropIt->GetName().Contains("DSS_"))
+			FloatProperties.Add(PropIt->GetName().Replace(TEXT("DSS_"), TEXT("")), *PropIt);
+	}
+
+	for (TFieldIterator<FProperty> PropIt(Class); PropIt; ++PropIt)
+	{
+		if (IsNameProperty(*PropIt) && PropIt->GetName().Contains("DSS_"))
+			NameProperties.Add(PropIt->GetName().Replace(TEXT("DSS_"), TEXT("")), *PropIt);
+	}
+
+	for (TFieldIterator<UFunction> FuncIt(Class, EFieldIteratorFlags::IncludeSuper); FuncIt; ++FuncIt)
+	{
+		UFunction* Function = *FuncIt;
+		if (!Function->GetName().Contains("DSS_"))
+			continue;
+
+		// Prevent errors
+		if (Function->NumParms != 1)
+		{
+			UE_LOG(DialogueContextComponent, Error,
+			       TEXT(
+				       "Function: %s takes more than one parameter. DSS callbacks should always take a Map<FString, FString> as the only parameter."
+			       ), *Function->GetName())
+		}
+
+		const FString CallbackName = Function->GetName().Replace(TEXT("DSS_"), TEXT(""));
+		CallbackNames.Add(CallbackName);
+
+		// Overrides are iterated before the functions they override, keep the most derived one
+		if (!Callbacks.Contains(CallbackName))
+			Callbacks.Add(CallbackName, Function);
+	}
+}
+
+bool FDialogueClassDescriptor::IsNameProperty(const FProperty* Property)
+{
+	if (Property->IsA<FNameProperty>() || Property->IsA<FEnumProperty>())
+		return true;
+
+	// Enums declared as TEnumAsByte, and Blueprint enums, are byte properties with an enum attached
+	if (const FByteProperty* ByteProperty = CastField<FByteProperty>(Property))
+		return ByteProperty->Enum != nullptr;
+
+	const FStructProperty* StructProperty = CastField<FStructProperty>(Property);
+	return StructProperty && StructProperty->Struct == FGameplayTag::StaticStruct();
+}
+
+FName FDialogueClassDescriptor::ReadName(const FProperty* Property, const void* Container)
+{
+	const void* Value = Property->ContainerPtrToValuePtr<void>(Container);
+
+	if (const FNameProperty* NameProperty = CastField<FNameProperty>(Property))
+		return NameProperty->GetPropertyValue(Value);
+
+	if (const FStructProperty* StructProperty = CastField<FStructProperty>(Property))
+		return static_cast<const FGameplayTag*>(Value)->GetTagName();
+
+	// The short name ("Angry" rather than "EMood::Angry"), which is what the database refers to. Blueprint enums only
+	// have internal names ("NewEnumerator0"), the authored one is the display name the designer typed in
+	const UEnum* Enum;
+	int64 EnumValue;
+	if (const FEnumProperty* EnumProperty = CastField<FEnumProperty>(Property))
+	{
+		Enum = EnumProperty->GetEnum();
+		EnumValue = EnumProperty->GetUnderlyingProperty()->GetSignedIntPropertyValue(Value);
+	}
+	else
+	{
+		const FByteProperty* ByteProperty = CastFieldChecked<FByteProperty>(Property);
+		Enum = ByteProperty->Enum;
+		EnumValue = ByteProperty->GetPropertyValue(Value);
+	}
+
+	return Enum && Enum->IsValidEnumValue(EnumValue) ? FName(*Enum->GetAuthoredNameStringByValue(EnumValue)) : NAME_None;
+}
+
+bool FDialogueClassDescriptor::WriteName(const FProperty* Property, void* Container, const FName Value)
+{
+	void* ValuePtr = Property->ContainerPtrToValuePtr<void>(Container);
+
+	if (const FNameProperty* NameProperty = CastField<FNameProperty>(Property))
+	{
+		NameProperty->SetPropertyValue(ValuePtr, Value);
+		return true;
+	}
+
+	if (CastField<FStructProperty>(Property))
+	{
+		// Unregistered tags are refused rather than turned into an invalid tag, the empty name clears the tag
+		const FGameplayTag Tag = FGameplayTag::RequestGameplayTag(Value, false);
+		if (!Tag.IsValid() && !Value.IsNone())
+			return false;
+
+		*static_cast<FGameplayTag*>(ValuePtr) = Tag;
+		return true;
+	}
+
+	const FEnumProperty* EnumProperty = CastField<FEnumProperty>(Property);
+	const FByteProperty* ByteProperty = EnumProperty ? nullptr : CastFieldChecked<FByteProperty>(Property);
+	const UEnum* Enum = EnumProperty ? EnumProperty->GetEnum() : ByteProperty->Enum;
+	if (!Enum)
+		return false;
+
+	// Accepts both the short and the full name of the enumerator, and the authored name of a Blueprint enumerator
+	const int64 EnumValue = Enum->GetValueByNameString(Value.ToString(), EGetByNameFlags::CheckAuthoredName);
+	if (EnumValue == INDEX_NONE)
+		return false;
+
+	if (EnumProperty)
+		EnumProperty->GetUnderlyingProperty()->SetIntPropertyValue(ValuePtr, EnumValue);
+	else
+		ByteProperty->SetPropertyValue(ValuePtr, static_cast<uint8>(EnumValue));
+	return true;
+}
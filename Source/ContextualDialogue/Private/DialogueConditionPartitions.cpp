@@ -0,0 +1,217 @@
+#include "DialogueConditionPartitions.h"
+
+void FDialogueConditionPartitions::Reset()
+{
+	Remainder.Empty();
+	VariableLookup.Empty();
+	Variables.Empty();
+	LineKeys.Empty();
+	NumPartitioned = 0;
+}
+
+void FDialogueConditionPartitions::AddLine(const UContextualDialogueLine* Line)
+{
+	const int32 LineIdx = Line->DenseIndex;
+	check(LineIdx != INDEX_NONE);
+
+	if (LineIdx >= LineKeys.Num())
+	{
+		LineKeys.SetNum(LineIdx + 1);
+		Remainder.SetNum(LineIdx + 1);
+	}
+
+	Remainder.Set(LineIdx);
+}
+
+void FDialogueConditionPartitions::RemoveLine(const UContextualDialogueLine* Line)
+{
+	const int32 LineIdx = Line->DenseIndex;
+	if (!LineKeys.IsValidIndex(LineIdx))
+		return;
+
+	FDialogueCondition& Key = LineKeys[LineIdx];
+	if (Key.IsValidReference)
+	{
+		if (FDialoguePostingList* Partition = FindPartition(Key, false))
+			FDialoguePostingListUtils::Remove(*Partition, LineIdx);
+
+		Key = FDialogueCondition();
+		NumPartitioned--;
+	}
+
+	Remainder.Clear(LineIdx);
+}
+
+bool FDialogueConditionPartitions::IsKeyCandidate(const FDialogueCondition& Condition, const bool bIsFilter)
+{
+	// Only an unmet critical condition or filter guarantees the line is out. A fractional literal can't be a key of
+	// the integer partitions, and it is rare enough not to deserve partitions of its own. Keys are read by the slots
+	// (and literal ids) they have been bound to
+	return Condition.IsValidReference && Condition.VariableRef.IsValid() && Condition.ConditionType == EQUAL && Condition.LiteralType != EDialogueLiteralType::Float
+		&& (bIsFilter || Condition.IsCritical);
+}
+
+FDialoguePostingList* FDialogueConditionPartitions::FindPartition(const FDialogueCondition& Condition, const bool bCreate)
+{
+	int32 VariableIdx = INDEX_NONE;
+	if (const TMap<FString, int32>* ObjectVariables = VariableLookup.Find(Condition.ObjectId))
+	{
+		if (const int32* Existing = ObjectVariables->Find(Condition.VariableId))
+			VariableIdx = *Existing;
+	}
+
+	if (VariableIdx == INDEX_NONE)
+	{
+		if (!bCreate)
+			return nullptr;
+
+		VariableIdx = Variables.AddDefaulted();
+		Variables[VariableIdx].ObjectId = Condition.ObjectId;
+		Variables[VariableIdx].VariableId = Condition.VariableId;
+		Variables[VariableIdx].Ref = Condition.VariableRef;
+		VariableLookup.FindOrAdd(Condition.ObjectId).Add(Condition.VariableId, VariableIdx);
+	}
+
+	FPartitionedVariable& Variable = Variables[VariableIdx];
+	if (Condition.LiteralType == EDialogueLiteralType::Integer)
+		return bCreate ? &Variable.IntPartitions.FindOrAdd(Condition.IntValue) : Variable.IntPartitions.Find(Condition.IntValue);
+
+	return bCreate ? &Variable.StrPartitions.FindOrAdd(Condition.LiteralStrId) : Variable.StrPartitions.Find(Condition.LiteralStrId);
+}
+
+void FDialogueConditionPartitions::Rebuild(const TArray<UContextualDialogueLine*>& Lines)
+{
+	Reset();
+	LineKeys.SetNum(Lines.Num());
+	Remainder.Init(Lines.Num(), false);
+
+	// Count how many lines share every key candidate - the fewer, the more of the database its partition leaves out
+	TMap<FString, int32> KeyCounts;
+	auto MakeKey = [](const FDialogueCondition& Condition)
+	{
+		return Condition.ObjectId + TEXT(".") + Condition.VariableId + TEXT("=") + Condition.ValueToCompare;
+	};
+
+	auto ForEachKeyCandidate = [](const UContextualDialogueLine* Line, auto&& Func)
+	{
+		for (const FDialogueCondition& Condition : Line->Filters)
+		{
+			if (IsKeyCandidate(Condition, true))
+				Func(Condition);
+		}
+		for (const FDialogueCondition& Condition : Line->Conditions)
+		{
+			if (IsKeyCandidate(Condition, false))
+				Func(Condition);
+		}
+	};
+
+	for (const UContextualDialogueLine* Line : Lines)
+	{
+		if (Line)
+			ForEachKeyCandidate(Line, [&](const FDialogueCondition& Condition) { KeyCounts.FindOrAdd(MakeKey(Condition))++; });
+	}
+
+	for (int32 LineIdx = 0; LineIdx < Lines.Num(); LineIdx++)
+	{
+		const UContextualDialogueLine* Line = Lines[LineIdx];
+		if (!Line)
+			continue;
+
+		const FDialogueCondition* BestKey = nullptr;
+		int32 BestCount = MAX_int32;
+		ForEachKeyCandidate(Line, [&](const FDialogueCondition& Condition)
+		{
+			const int32 Count = KeyCounts.FindChecked(MakeKey(Condition));
+			if (Count < BestCount)
+			{
+				BestKey = &Condition;
+				BestCount = Count;
+			}
+		});
+
+		if (!BestKey)
+		{
+			Remainder.Set(LineIdx);
+			continue;
+		}
+
+		FDialoguePostingListUtils::Insert(*FindPartition(*BestKey, true), LineIdx);
+		LineKeys[LineIdx] = *BestKey;
+		NumPartitioned++;
+	}
+}
+
+void FDialogueConditionPartitions::BuildMask(const FDialogueWorldStateStore& State, const int32 NumLines,
+                                             FDialogueBitSet& OutMask) const
+{
+	OutMask.CopyFrom(Remainder);
+	OutMask.SetNum(NumLines);
+
+	for (const FPartitionedVariable& Variable : Variables)
+	{
+		// Key conditions of missing objects are never fulfilled
+		if (!Variable.Ref.IsValid() || !State.IsObjectLive(Variable.Ref.ObjectIdx))
+			continue;
+
+		int32 WholeValue;
+		bool bFraction;
+		if (State.ReadWhole(Variable.Ref, WholeValue, bFraction) && !bFraction)
+		{
+			if (const FDialoguePostingList* Partition = Variable.IntPartitions.Find(WholeValue))
+			{
+				for (const int32 LineIdx : *Partition)
+					OutMask.Set(LineIdx);
+			}
+		}
+
+		if (const FDialoguePostingList* Partition = Variable.StrPartitions.Find(State.ReadStrId(Variable.Ref)))
+		{
+			for (const int32 LineIdx : *Partition)
+				OutMask.Set(LineIdx);
+		}
+	}
+}
+
+int32 FDialogueConditionPartitions::CountMatches(const FDialogueWorldStateStore& State) const
+{
+	int32 Count = Remainder.CountSetBits();
+
+	for (const FPartitionedVariable& Variable : Variables)
+	{
+		if (!Variable.Ref.IsValid() || !State.IsObjectLive(Variable.Ref.ObjectIdx))
+			continue;
+
+		int32 WholeValue;
+		bool bFraction;
+		if (State.ReadWhole(Variable.Ref, WholeValue, bFraction) && !bFraction)
+		{
+			if (const FDialoguePostingList* Partition = Variable.IntPartitions.Find(WholeValue))
+				Count += Partition->Num();
+		}
+
+		if (const FDialoguePostingList* Partition = Variable.StrPartitions.Find(State.ReadStrId(Variable.Ref)))
+			Count += Partition->Num();
+	}
+
+	return Count;
+}
+
+bool FDialogueConditionPartitions::IsLineViable(const int32 LineIdx, const FDialogueWorldStateStore& State) const
+{
+	if (!LineKeys.IsValidIndex(LineIdx) || !LineKeys[LineIdx].IsValidReference)
+		return true;
+
+	const FDialogueCondition& Key = LineKeys[LineIdx];
+	if (!Key.VariableRef.IsValid() || !State.IsObjectLive(Key.VariableRef.ObjectIdx))
+		return false;
+
+	if (Key.LiteralType == EDialogueLiteralType::Integer)
+	{
+		int32 WholeValue;
+		bool bFraction;
+		return State.ReadWhole(Key.VariableRef, WholeValue, bFraction) && !bFraction && WholeValue == Key.IntValue;
+	}
+
+	return State.ReadStrId(Key.VariableRef) == Key.LiteralStrId;
+}
@@ -0,0 +1,222 @@
+#include "DialogueConditionTable.h"
+
+#include "DialogueDependencyGraph.h"
+
+/** Integer conditions evaluated by a single vector compare */
+static constexpr int32 IntVectorWidth = 4;
+
+void FDialogueConditionTable::Reset()
+{
+	Lookup.Empty();
+
+	SlotLookup.Empty();
+	SlotGraphIds.Empty();
+	SlotRefs.Empty();
+	SlotGatheredVersions.Empty();
+	SlotValues.Empty();
+	SlotPresent.Empty();
+	SlotFraction.Empty();
+
+	NumIntConditions = 0;
+	IntSlots.Empty();
+	IntConstants.Empty();
+	IntAcceptLess.Empty();
+	IntAcceptEqual.Empty();
+	IntAcceptGreater.Empty();
+	IntGathered.Empty();
+	IntGatheredPresent.Empty();
+	IntGatheredFraction.Empty();
+	IntResults.Empty();
+
+	StrConditions.Empty();
+	StrVariableIds.Empty();
+	StrEvaluatedVersions.Empty();
+	StrResults.Empty();
+
+	RefreshedVersion = 0;
+}
+
+int32 FDialogueConditionTable::Intern(FDialogueCondition& Condition, FDialogueDependencyGraph& Graph)
+{
+	if (!Condition.IsValidReference)
+	{
+		Condition.TableId = INDEX_NONE;
+		return INDEX_NONE;
+	}
+
+	const FConditionKey Key{Condition.ObjectId, Condition.VariableId, Condition.ValueToCompare, Condition.ConditionType};
+	if (const int32* Existing = Lookup.Find(Key))
+	{
+		Condition.TableId = *Existing;
+		return *Existing;
+	}
+
+	const int32 GraphId = Graph.FindOrAddVariable(Condition.ObjectId, Condition.VariableId);
+	int32 NewId;
+
+	if (Condition.LiteralType == EDialogueLiteralType::Integer)
+	{
+		int32 Slot;
+		if (const int32* ExistingSlot = SlotLookup.Find(GraphId))
+		{
+			Slot = *ExistingSlot;
+		}
+		else
+		{
+			Slot = SlotGraphIds.Add(GraphId);
+			SlotRefs.Add(Condition.VariableRef);
+			SlotGatheredVersions.Add(0);
+			SlotValues.Add(0);
+			SlotPresent.Add(0);
+			SlotFraction.Add(0);
+			SlotLookup.Add(GraphId, Slot);
+		}
+
+		// Keep the arrays padded to whole vectors, the padding entries accept nothing
+		const int32 Index = NumIntConditions++;
+		if (Index >= IntSlots.Num())
+		{
+			const int32 PaddedNum = Align(NumIntConditions, IntVectorWidth);
+			IntSlots.SetNumZeroed(PaddedNum);
+			IntConstants.SetNumZeroed(PaddedNum);
+			IntAcceptLess.SetNumZeroed(PaddedNum);
+			IntAcceptEqual.SetNumZeroed(PaddedNum);
+			IntAcceptGreater.SetNumZeroed(PaddedNum);
+			IntGathered.SetNumZeroed(PaddedNum);
+			IntGatheredPresent.SetNumZeroed(PaddedNum);
+			IntGatheredFraction.SetNumZeroed(PaddedNum);
+		}
+
+		const EContextDialogueConditionType Type = Condition.ConditionType;
+		IntSlots[Index] = Slot;
+		IntConstants[Index] = Condition.IntValue;
+		IntAcceptLess[Index] = (Type == LT || Type == LET) ? ~0 : 0;
+		IntAcceptEqual[Index] = (Type == EQUAL || Type == LET || Type == GET) ? ~0 : 0;
+		IntAcceptGreater[Index] = (Type == GT || Type == GET) ? ~0 : 0;
+		IntResults.SetNum(NumIntConditions);
+
+		NewId = Index << 1;
+	}
+	else
+	{
+		const int32 Index = StrConditions.Add(Condition);
+		StrVariableIds.Add(GraphId);
+		StrEvaluatedVersions.Add(0);
+		StrResults.SetNum(StrConditions.Num());
+
+		NewId = (Index << 1) | 1;
+		StrConditions[Index].TableId = NewId;
+	}
+
+	Lookup.Add(Key, NewId);
+
+	// The new condition has never been evaluated
+	RefreshedVersion = 0;
+
+	Condition.TableId = NewId;
+	return NewId;
+}
+
+void FDialogueConditionTable::Refresh(const FDialogueDependencyGraph& Graph, FReadIntFunc ReadInt, FEvaluateFunc Evaluate)
+{
+	const uint64 Version = Graph.GetVersion();
+	if (Version == RefreshedVersion)
+		return;
+
+	// Re-evaluating all the integer conditions in bulk is cheaper than finding out which of them actually changed
+	if (GatherSlots(Graph, ReadInt))
+		EvaluateIntConditions();
+
+	for (int32 Index = 0; Index < StrConditions.Num(); Index++)
+	{
+		// Freshly interned conditions are at version 0, so they are always evaluated here
+		if (StrEvaluatedVersions[Index] != 0 && Graph.GetVariableVersion(StrVariableIds[Index]) <= StrEvaluatedVersions[Index])
+			continue;
+
+		if (Evaluate(StrConditions[Index]))
+			StrResults.Set(Index);
+		else
+			StrResults.Clear(Index);
+
+		StrEvaluatedVersions[Index] = Version;
+	}
+
+	RefreshedVersion = Version;
+}
+
+bool FDialogueConditionTable::GatherSlots(const FDialogueDependencyGraph& Graph, FReadIntFunc ReadInt)
+{
+	const uint64 Version = Graph.GetVersion();
+	bool bAnyChanged = false;
+
+	for (int32 Slot = 0; Slot < SlotGraphIds.Num(); Slot++)
+	{
+		if (SlotGatheredVersions[Slot] != 0 && Graph.GetVariableVersion(SlotGraphIds[Slot]) <= SlotGatheredVersions[Slot])
+			continue;
+
+		int32 Value = 0;
+		bool bFraction = false;
+		const bool bPresent = ReadInt(SlotRefs[Slot], Value, bFraction);
+		SlotValues[Slot] = bPresent ? Value : 0;
+		SlotPresent[Slot] = bPresent ? ~0 : 0;
+		SlotFraction[Slot] = bPresent && bFraction ? ~0 : 0;
+		SlotGatheredVersions[Slot] = Version;
+		bAnyChanged = true;
+	}
+
+	// A new condition may reuse an already gathered slot, it still has to be evaluated
+	return bAnyChanged || RefreshedVersion == 0;
+}
+
+void FDialogueConditionTable::EvaluateIntConditions()
+{
+	const int32 PaddedNum = IntSlots.Num();
+
+	// Gather the slot values next to their conditions, so that the compares below only ever read contiguous memory
+	for (int32 Index = 0; Index < PaddedNum; Index++)
+	{
+		IntGathered[Index] = SlotValues[IntSlots[Index]];
+		IntGatheredPresent[Index] = SlotPresent[IntSlots[Index]];
+		IntGatheredFraction[Index] = SlotFraction[IntSlots[Index]];
+	}
+
+	uint64 Word = 0;
+	for (int32 Index = 0; Index < PaddedNum; Index += IntVectorWidth)
+	{
+		const VectorRegister4Int Values = VectorIntLoad(&IntGathered[Index]);
+		const VectorRegister4Int Constants = VectorIntLoad(&IntConstants[Index]);
+
+		const VectorRegister4Int Fraction = VectorIntLoad(&IntGatheredFraction[Index]);
+
+		// A float whose whole part equals the constant is above it if anything has been cut off
+		const VectorRegister4Int WholeEqual = VectorIntCompareEQ(Values, Constants);
+		const VectorRegister4Int IsEqual = VectorIntAndNot(Fraction, WholeEqual);
+		const VectorRegister4Int IsGreater = VectorIntOr(VectorIntCompareGT(Values, Constants), VectorIntAnd(WholeEqual, Fraction));
+
+		const VectorRegister4Int Less = VectorIntAnd(VectorIntCompareLT(Values, Constants), VectorIntLoad(&IntAcceptLess[Index]));
+		const VectorRegister4Int Equal = VectorIntAnd(IsEqual, VectorIntLoad(&IntAcceptEqual[Index]));
+		const VectorRegister4Int Greater = VectorIntAnd(IsGreater, VectorIntLoad(&IntAcceptGreater[Index]));
+
+		const VectorRegister4Int Fulfilled = VectorIntAnd(VectorIntOr(VectorIntOr(Less, Equal), Greater), VectorIntLoad(&IntGatheredPresent[Index]));
+		const uint64 Bits = static_cast<uint64>(VectorMaskBits(VectorCastIntToFloat(Fulfilled)));
+		Word |= Bits << (Index & 63);
+
+		// Flush every full word, and the last partial one
+		if ((Index & 63) == 64 - IntVectorWidth || Index + IntVectorWidth >= PaddedNum)
+		{
+			IntResults.SetWord(Index >> 6, Word);
+			Word = 0;
+		}
+	}
+}
+
+bool FDialogueConditionTable::AreAllFulfilled(const TArray<FDialogueCondition>& Filters) const
+{
+	for (const FDialogueCondition& Condition : Filters)
+	{
+		if (!IsFulfilled(Condition.TableId))
+			return false;
+	}
+
+	return true;
+}
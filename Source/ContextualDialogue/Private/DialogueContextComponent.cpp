@@ -2,6 +2,7 @@
 
 
 #include "DialogueContextComponent.h"
+#include "DialogueClassDescriptor.h"
 #include "DialogueManagerSubsystem.h"
 #include "Kismet/GameplayStatics.h"
 
@@ -17,11 +18,6 @@ void UDialogueContextComponent::BeginPlay()
 	Super::BeginPlay();
 
 	Owner = this->GetOwner();
-	
-	// Initialize int and string variables with whatever values are present in the Owner
-	IntVars = PopulateIntStateVariables();
-	StrVars = PopulateStrStateVariables();
-	CallbackNames = PopulateCallbackStateVariables();
 
 	// In case this property was left empty by dum-dum designers
 	if(DSS_Name.IsEmpty())
@@ -58,21 +54,13 @@ TMap<FString, int> UDialogueContextComponent::PopulateIntStateVariables()
 {
 	TMap<FString, int> Result;
 
-	// Iterate over all of the FIntProperties present in the owning actor
-	for (TFieldIterator<FIntProperty> PropIt(Owner->GetClass()); PropIt; ++PropIt)
+	// Iterate over the DSS_ integer properties of the owning actor, found once per class
+	for (const TPair<FString, const FIntProperty*>& Property : GetClassDescriptor().IntProperties)
 	{
-		// Get property from iterator
-		const FProperty* Property = *PropIt;
+		const int32 Value = Property.Value->GetPropertyValue_InContainer(Owner);
+		Result.Add(Property.Key, Value);
 
-		// Check if it's our Dialogue System State (we rely on the variable names being prefixed with "DSS_")
-		if(Property->GetName().Contains("DSS_"))
-		{
-			// Get value of the property and add it to results. NOTE that the "DSS_" prefix is removed
-			int32 Value = PropIt->GetSignedIntPropertyValue(Property->ContainerPtrToValuePtr<UObject>(Owner));
-			Result.Add(Property->GetName().Replace(TEXT("DSS_"), TEXT("")), Value);
-			
-			UE_LOG(DialogueContextComponent, Display, TEXT("Int Field: %s, value: %s"), *Property->GetName(), *FString::FromInt(Value))
-		}
+		UE_LOG(DialogueContextComponent, Display, TEXT("Int Field: %s, value: %s"), *Property.Value->GetName(), *FString::FromInt(Value))
 	}
 	return Result;
 }
@@ -81,47 +69,20 @@ TMap<FString, FString> UDialogueContextComponent::PopulateStrStateVariables()
 {
 	TMap<FString, FString> Result;
 
-	// Iterate over all of the FStrProperty present in the owning actor
-	for (TFieldIterator<FStrProperty> PropIt(Owner->GetClass()); PropIt; ++PropIt)
+	// Iterate over the DSS_ string properties of the owning actor, found once per class
+	for (const TPair<FString, const FStrProperty*>& Property : GetClassDescriptor().StrProperties)
 	{
-		// Get property from iterator
-		const FProperty* Property = *PropIt;
+		const FString& Value = Property.Value->GetPropertyValue_InContainer(Owner);
+		Result.Add(Property.Key, Value);
 
-		// Check if it's our Dialogue System State (we rely on the variable names being prefixed with "DSS_")
-		if(Property->GetName().Contains("DSS_"))
-		{
-			// Get value of the property and add it to results. NOTE that the "DSS_" prefix is removed
-			FString Value = PropIt->GetPropertyValue(Property->ContainerPtrToValuePtr<UObject>(GetOwner()));
-			Result.Add(Property->GetName().Replace(TEXT("DSS_"), TEXT("")), Value);
-			
-			UE_LOG(DialogueContextComponent, Display, TEXT("String Field: %s, value: %s"), *Property->GetName(), *Value)
-		}
+		UE_LOG(DialogueContextComponent, Display, TEXT("String Field: %s, value: %s"), *Property.Value->GetName(), *Value)
 	}
 	return Result;
 }
 
 TArray<FString> UDialogueContextComponent::PopulateCallbackStateVariables()
 {
-	TArray<FString> Result;
-
-	for (TFieldIterator<UFunction> FuncIt (Owner->GetClass(), EFieldIteratorFlags::IncludeSuper); FuncIt; ++FuncIt) {
-		const UFunction* Function = *FuncIt;
-
-		if (Function->GetName().Contains("DSS_"))
-		{
-			// Prevent errors
-			if (Function->NumParms != 1)
-			{
-				UE_LOG(DialogueContextComponent, Error,
-				       TEXT(
-					       "Function: %s takes more than one parameter. DSS callbacks should always take a Map<FString, FString> as the only parameter."
-				       ), *Function->GetName())
-			}
-			
-			Result.Add(Function->GetName().Replace(TEXT("DSS_"), TEXT("")));
-		}
-	}
-	return Result;
+	return GetClassDescriptor().CallbackNames;
 }
 
 void UDialogueContextComponent::UpdateStrValue(const FString VarName, const FString NewVal)
@@ -132,17 +93,19 @@ void UDialogueContextComponent::UpdateStrValue(const FString VarName, const FStr
 		TEXT("[DIALOGUE] DialogueContextComponent. Will update variable: %s with new value: %s"), *VarName, *NewVal
 	)
 
-	// Update the variable in the mapping
-	StrVars.Emplace(VarName, NewVal);
-	
-	// Iterate over all of the FStrProperty present in the owning actor
-	for (TFieldIterator<FStrProperty> PropIt(GetOwner()->GetClass()); PropIt; ++PropIt)
+	// Set the property to a new value, if the owning actor has one with a matching name (+ "DSS_" prefix)
+	const FDialogueClassDescriptor& Descriptor = GetClassDescriptor();
+	if (const FStrProperty* Property = Descriptor.StrProperties.FindRef(VarName))
+	{
+		Property->SetPropertyValue_InContainer(Owner, NewVal);
+	}
+	else if (const FProperty* NameProperty = Descriptor.NameProperties.FindRef(VarName))
 	{
-		// Until we find a variable whose name matches the one passed to the function (+ "DSS_" prefix)
-		if(PropIt->GetName().Equals("DSS_" + VarName))
+		// Names are limited to NAME_SIZE characters, a longer string can't be a valid value anyway
+		if (NewVal.Len() >= NAME_SIZE || !FDialogueClassDescriptor::WriteName(NameProperty, Owner, FName(*NewVal)))
 		{
-			// Set the property to a new value
-			PropIt->SetPropertyValue_InContainer(this->GetOwner(), NewVal);
+			UE_LOG(DialogueContextComponent, Warning, TEXT("[DIALOGUE] %s is not a valid value of DSS_%s, the variable is left unchanged"),
+			       *NewVal, *VarName)
 		}
 	}
 }
@@ -155,39 +118,155 @@ void UDialogueContextComponent::UpdateIntValue(const FString VarName, const int
 		TEXT("[DIALOGUE] DialogueContextComponent. Will update variable: %s with new value: %s"), *VarName, *FString::FromInt(NewVal)
 	)
 
-	// Update the variable in the mapping
-	IntVars.Emplace(VarName, NewVal);
-	
-	// Iterate over all of the FIntProperty present in the owning actor
-	for (TFieldIterator<FIntProperty> PropIt(GetOwner()->GetClass()); PropIt; ++PropIt)
+	// Set the property to a new value, if the owning actor has one with a matching name (+ "DSS_" prefix)
+	const FDialogueClassDescriptor& Descriptor = GetClassDescriptor();
+	if (const FIntProperty* Property = Descriptor.IntProperties.FindRef(VarName))
+		Property->SetPropertyValue_InContainer(Owner, NewVal);
+	else if (const FBoolProperty* BoolProperty = Descriptor.BoolProperties.FindRef(VarName))
+		BoolProperty->SetPropertyValue_InContainer(Owner, NewVal != 0);
+}
+
+void UDialogueContextComponent::UpdateFloatValue(const FString& VarName, const double NewVal)
+{
+	UE_LOG(
+		DialogueContextComponent,
+		Display,
+		TEXT("[DIALOGUE] DialogueContextComponent. Will update variable: %s with new value: %s"), *VarName, *FString::SanitizeFloat(NewVal)
+	)
+
+	if (const FNumericProperty* Property = GetClassDescriptor().FloatProperties.FindRef(VarName))
+		Property->SetFloatingPointPropertyValue(Property->ContainerPtrToValuePtr<void>(Owner), NewVal);
+}
+
+bool UDialogueContextComponent::IsDialogueVarConstrained(const FString& VarName)
+{
+	const FDialogueClassDescriptor& Descriptor = GetClassDescriptor();
+	return Descriptor.NameProperties.Contains(VarName) || Descriptor.BoolProperties.Contains(VarName);
+}
+
+void UDialogueContextComponent::SetDialogueIntVar(const FString& VarName, const int32 NewVal)
+{
+	UpdateIntValue(VarName, NewVal);
+
+	// A boolean holds true rather than the number it was set to
+	if (IsDialogueVarConstrained(VarName))
 	{
-		// Until we find a variable whose name matches the one passed to the function (+ "DSS_" prefix)
-		if(PropIt->GetName().Equals("DSS_" + VarName))
-		{
-			// Set the property to a new value
-			PropIt->SetPropertyValue_InContainer(this->GetOwner(), NewVal);
-		}
+		MarkDialogueVarDirty(VarName);
+		return;
 	}
+
+	if (UDialogueManagerSubsystem* MySubsystem = GetDialogueSubsystem())
+		MySubsystem->PushIntValue(DSS_Name, VarName, NewVal);
 }
 
-void UDialogueContextComponent::ExecuteCallback(FString CallbackName, TMap<FString, FString> CallbackParameters)
+void UDialogueContextComponent::SetDialogueStrVar(const FString& VarName, const FString& NewVal)
 {
-	for (TFieldIterator<UFunction> FuncIt (Owner->GetClass(), EFieldIteratorFlags::IncludeSuper); FuncIt; ++FuncIt) {
-		UFunction* Function = *FuncIt;
+	UpdateStrValue(VarName, NewVal);
 
-		if(Function->GetName().Equals("DSS_" + CallbackName))
-		{
-			struct FLocalParameters
-			{
-				TMap<FString, FString> Params;
-			};
-
-			FLocalParameters Parameters;
-			Parameters.Params = CallbackParameters;
-			
-			Owner->ProcessEvent(Function, &Parameters);
-			return;
-		}
+	// Names, enums and tags may have refused the value, so push whatever the actor ended up with
+	if (IsDialogueVarConstrained(VarName))
+	{
+		MarkDialogueVarDirty(VarName);
+		return;
 	}
+
+	if (UDialogueManagerSubsystem* MySubsystem = GetDialogueSubsystem())
+		MySubsystem->PushStrValue(DSS_Name, VarName, NewVal);
 }
 
+void UDialogueContextComponent::SetDialogueFloatVar(const FString& VarName, const double NewVal)
+{
+	UpdateFloatValue(VarName, NewVal);
+
+	if (UDialogueManagerSubsystem* MySubsystem = GetDialogueSubsystem())
+		MySubsystem->PushFloatValue(DSS_Name, VarName, NewVal);
+}
+
+void UDialogueContextComponent::SetDialogueBoolVar(const FString& VarName, const bool NewVal)
+{
+	UpdateIntValue(VarName, NewVal ? 1 : 0);
+
+	if (UDialogueManagerSubsystem* MySubsystem = GetDialogueSubsystem())
+		MySubsystem->PushIntValue(DSS_Name, VarName, NewVal ? 1 : 0);
+}
+
+void UDialogueContextComponent::MarkDialogueVarDirty(const FString& VarName)
+{
+	if (!Owner)
+		return;
+
+	UDialogueManagerSubsystem* MySubsystem = GetDialogueSubsystem();
+	const FDialogueClassDescriptor& Descriptor = GetClassDescriptor();
+
+	if (const FIntProperty* IntProperty = Descriptor.IntProperties.FindRef(VarName))
+	{
+		const int32 Value = IntProperty->GetPropertyValue_InContainer(Owner);
+		if (MySubsystem)
+			MySubsystem->PushIntValue(DSS_Name, VarName, Value);
+	}
+	else if (const FStrProperty* StrProperty = Descriptor.StrProperties.FindRef(VarName))
+	{
+		const FString& Value = StrProperty->GetPropertyValue_InContainer(Owner);
+		if (MySubsystem)
+			MySubsystem->PushStrValue(DSS_Name, VarName, Value);
+	}
+	else if (const FBoolProperty* BoolProperty = Descriptor.BoolProperties.FindRef(VarName))
+	{
+		const bool Value = BoolProperty->GetPropertyValue_InContainer(Owner);
+		if (MySubsystem)
+			MySubsystem->PushIntValue(DSS_Name, VarName, Value ? 1 : 0);
+	}
+	else if (const FNumericProperty* FloatProperty = Descriptor.FloatProperties.FindRef(VarName))
+	{
+		const double Value = FloatProperty->GetFloatingPointPropertyValue(FloatProperty->ContainerPtrToValuePtr<void>(Owner));
+		if (MySubsystem)
+			MySubsystem->PushFloatValue(DSS_Name, VarName, Value);
+	}
+	else if (const FProperty* NameProperty = Descriptor.NameProperties.FindRef(VarName))
+	{
+		const FName Value = FDialogueClassDescriptor::ReadName(NameProperty, Owner);
+		if (MySubsystem)
+			MySubsystem->PushNameValue(DSS_Name, VarName, Value);
+	}
+	else
+	{
+		UE_LOG(DialogueContextComponent, Warning, TEXT("[DIALOGUE] %s has no DSS_%s variable"), *DSS_Name, *VarName)
+	}
+}
+
+void UDialogueContextComponent::MarkAllDialogueVarsDirty()
+{
+	if (!Owner)
+		return;
+
+	if (UDialogueManagerSubsystem* MySubsystem = GetDialogueSubsystem())
+		MySubsystem->PushComponentState(this);
+}
+
+UDialogueManagerSubsystem* UDialogueContextComponent::GetDialogueSubsystem() const
+{
+	const UGameInstance* GameInstance = UGameplayStatics::GetGameInstance(GetWorld());
+	return GameInstance ? GameInstance->GetSubsystem<UDialogueManagerSubsystem>() : nullptr;
+}
+
+const FDialogueClassDescriptor& UDialogueContextComponent::GetClassDescriptor()
+{
+	return FDialogueClassDescriptor::Get(GetOwner()->GetClass());
+}
+
+void UDialogueContextComponent::ExecuteCallback(FString CallbackName, TMap<FString, FString> CallbackParameters)
+{
+	UFunction* Function = GetClassDescriptor().Callbacks.FindRef(CallbackName);
+	if (!Function)
+		return;
+
+	struct FLocalParameters
+	{
+		TMap<FString, FString> Params;
+	};
+
+	FLocalParameters Parameters;
+	Parameters.Params = MoveTemp(CallbackParameters);
+
+	Owner->ProcessEvent(Function, &Parameters);
+}
@@ -0,0 +1,129 @@
+#include "DialogueDependencyGraph.h"
+
+#include "DialogueManagerUtils.h"
+
+void FDialogueDependencyGraph::Reset(const int32 NumLines)
+{
+	VariableIds.Empty();
+	Dependents.Empty();
+	VariableVersions.Empty();
+	LineVariables.Empty();
+	LineVariables.SetNum(NumLines);
+	DirtyLines.Init(NumLines, true);
+	GlobalVersion++;
+}
+
+int32 FDialogueDependencyGraph::FindOrAddVariable(const FString& ObjectName, const FString& VarName)
+{
+	TMap<FString, int32>& ObjectVariables = VariableIds.FindOrAdd(ObjectName);
+	if (const int32* Existing = ObjectVariables.Find(VarName))
+		return *Existing;
+
+	const int32 NewId = Dependents.AddDefaulted();
+	VariableVersions.Add(GlobalVersion);
+	ObjectVariables.Add(VarName, NewId);
+	return NewId;
+}
+
+void FDialogueDependencyGraph::AddLine(const UContextualDialogueLine* Line)
+{
+	const int32 LineIdx = Line->DenseIndex;
+	check(LineIdx != INDEX_NONE);
+
+	if (LineIdx >= LineVariables.Num())
+	{
+		LineVariables.SetNum(LineIdx + 1);
+		DirtyLines.SetNum(LineIdx + 1);
+	}
+
+	auto AddConditions = [&](const TArray<FDialogueCondition>& Conditions)
+	{
+		for (const FDialogueCondition& Condition : Conditions)
+		{
+			// Invalid references are never fulfilled, nothing can change that
+			if (!Condition.IsValidReference)
+				continue;
+
+			const int32 VariableId = FindOrAddVariable(Condition.ObjectId, Condition.VariableId);
+			FDialoguePostingListUtils::Insert(Dependents[VariableId], LineIdx);
+			LineVariables[LineIdx].AddUnique(VariableId);
+		}
+	};
+
+	AddConditions(Line->Conditions);
+	AddConditions(Line->Filters);
+
+	DirtyLines.Set(LineIdx);
+}
+
+void FDialogueDependencyGraph::RemoveLine(const UContextualDialogueLine* Line)
+{
+	const int32 LineIdx = Line->DenseIndex;
+	if (!LineVariables.IsValidIndex(LineIdx))
+		return;
+
+	for (const int32 VariableId : LineVariables[LineIdx])
+		FDialoguePostingListUtils::Remove(Dependents[VariableId], LineIdx);
+
+	LineVariables[LineIdx].Empty();
+	DirtyLines.Clear(LineIdx);
+}
+
+void FDialogueDependencyGraph::MarkVariableIdDirty(const int32 VariableId)
+{
+	VariableVersions[VariableId] = ++GlobalVersion;
+	for (const int32 LineIdx : Dependents[VariableId])
+		DirtyLines.Set(LineIdx);
+}
+
+void FDialogueDependencyGraph::MarkVariableDirty(const FString& ObjectName, const FString& VarName)
+{
+	// Variables that no line reads don't need to be tracked at all
+	if (const TMap<FString, int32>* ObjectVariables = VariableIds.Find(ObjectName))
+	{
+		if (const int32* VariableId = ObjectVariables->Find(VarName))
+			MarkVariableIdDirty(*VariableId);
+	}
+}
+
+void FDialogueDependencyGraph::MarkObjectDirty(const FString& ObjectName)
+{
+	if (const TMap<FString, int32>* ObjectVariables = VariableIds.Find(ObjectName))
+	{
+		for (const TPair<FString, int32>& Variable : *ObjectVariables)
+			MarkVariableIdDirty(Variable.Value);
+	}
+}
+
+void FDialogueDependencyGraph::MarkAllDirty()
+{
+	++GlobalVersion;
+	for (uint64& VariableVersion : VariableVersions)
+		VariableVersion = GlobalVersion;
+
+	DirtyLines.Init(LineVariables.Num(), true);
+}
+
+void FDialogueDependencyGraph::BuildVariableMask(const FString& ObjectName, const FString& VarName, FDialogueBitSet& OutMask) const
+{
+	OutMask.Init(LineVariables.Num(), false);
+
+	if (const TMap<FString, int32>* ObjectVariables = VariableIds.Find(ObjectName))
+	{
+		if (const int32* VariableId = ObjectVariables->Find(VarName))
+		{
+			for (const int32 LineIdx : Dependents[*VariableId])
+				OutMask.Set(LineIdx);
+		}
+	}
+}
+
+bool FDialogueDependencyGraph::IsLineStale(const int32 LineIndex, const uint64 Version) const
+{
+	for (const int32 VariableId : LineVariables[LineIndex])
+	{
+		if (VariableVersions[VariableId] > Version)
+			return true;
+	}
+	return false;
+}
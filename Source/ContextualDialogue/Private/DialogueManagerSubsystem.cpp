@@ -5,6 +5,9 @@
 
 #include "ContextualDialogueFunctionLibrary.h"
 #include "ContextualDialogueSettings.h"
+#include "DialogueClassDescriptor.h"
+#include "Async/Async.h"
+#include "Async/ParallelFor.h"
 #include "Blueprint/WidgetBlueprintLibrary.h"
 #include "Chaos/ChaosPerfTest.h"
 #include "HAL/FileManagerGeneric.h"
@@ -12,6 +15,8 @@
 #include "Misc/FileHelper.h"
 #include "Serialization/JsonReader.h"
 #include "Serialization/JsonSerializer.h"
+#include "Tasks/Task.h"
+#include "UObject/GarbageCollection.h"
 
 DEFINE_LOG_CATEGORY(DialogueManagerSubsystem);
 
@@ -51,6 +56,16 @@ bool UDialogueManagerSubsystem::LoadDialogueDatabaseFromJsonFile(FString FullFil
 	// Clean any pre-existing dialogue
 	DialogueDataBase.Empty();
 	DialogueLookup.Empty();
+	CategoryIndex.Reset();
+	DenseLines.Empty();
+	LiveLines.Empty();
+	ParameterIndex.Reset();
+	DependencyGraph.Reset(0);
+	DatabaseVersion++;
+	ConditionTable.Reset();
+	Partitions.Reset();
+	LineCache.Empty();
+	FilterPassLines.Empty();
 
 	// Attempt to load the raw contents of the file into a string
 	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
@@ -117,6 +132,7 @@ bool UDialogueManagerSubsystem::LoadDialogueDatabaseFromJsonFile(FString FullFil
 		// Remember the index at which we are adding and store it in the map for faster lookup later
 		size_t IdxAddedAt = DialogueDataBase.Add(LineAsset);
 		DialogueLookup.Add(LineAsset->UniqueName, LineAsset);
+		AddLineToIndices(LineAsset);
 
 		// Do it after the line has been added so that we can store a pointer to it
 		const TSharedPtr<FJsonObject>* ParsedCategories;
@@ -127,19 +143,16 @@ bool UDialogueManagerSubsystem::LoadDialogueDatabaseFromJsonFile(FString FullFil
 				FString Category = Filter.Key;
 				FString Value = Filter.Value->AsString();
 
-				// Check if this category of filter already exists
-				if (!Categories.Contains(Category))
-					Categories.Add(Category, {});
-
-				// Check if that type of filter in a given category exists
-				if (!Categories.Find(Category)->Contains(Value))
-					Categories.Find(Category)->Add(Value);
-
-				Categories.Find(Category)->Find(Value)->Add(LineAsset);
+				CategoryIndex.AddLine(LineAsset->DenseIndex, Category, Value);
 			}
 		}
 	}
 
+	// Partition keys depend on how selective the conditions are across the whole database
+	Partitions.Rebuild(DenseLines);
+	UE_LOG(DialogueManagerSubsystem, Display, TEXT("[DIALOGUE] Partitioned %i out of %i lines by their critical conditions"),
+	       Partitions.NumPartitionedLines(), DenseLines.Num())
+
 	return true;
 }
 
@@ -297,7 +310,8 @@ void UDialogueManagerSubsystem::UpdateWorldStateFromJSON(TSharedPtr<FJsonObject>
 	for(const TTuple<FString, TSharedPtr<FJsonValue, ESPMode::ThreadSafe>>& ContextMapping : ContextJSON->Values)
 	{
 		// No such object exists
-		if(!WorldState.Contains(ContextMapping.Key))
+		const int32 ObjectIdx = WorldStore.FindObject(ContextMapping.Key);
+		if(ObjectIdx == INDEX_NONE)
 		{
 			// WorldState.Add(ContextMapping.Key);
 			continue;
@@ -305,27 +319,27 @@ void UDialogueManagerSubsystem::UpdateWorldStateFromJSON(TSharedPtr<FJsonObject>
 
 		const TSharedPtr<FJsonObject>* Variables;
 		ContextMapping.Value->TryGetObject(Variables);
-		UDialogueContextComponent* DSS =  Cast<UDialogueContextComponent>(WorldState[ContextMapping.Key].ContextRef);
+		UDialogueContextComponent* DSS =  Cast<UDialogueContextComponent>(WorldStore.GetObject(ObjectIdx).ContextRef);
 		
 		for(const TTuple<FString, TSharedPtr<FJsonValue, ESPMode::ThreadSafe>>& Variable : Variables->Get()->Values)
 		{
 			const FString VariableName = Variable.Key;
 			
-			float OutNum;
+			// Numbers are kept as they are - a float variable (or a number with a fraction) is no longer truncated
+			double OutNum;
 			if(Variable.Value->TryGetNumber(OutNum))
 			{
-				WorldState[ContextMapping.Key].IntVals.Emplace(VariableName, OutNum);
-				if(DSS)
-					DSS->UpdateIntValue(VariableName, OutNum);
+				if(WorldStore.FindFloat(ObjectIdx, VariableName) != nullptr || FMath::Frac(OutNum) != 0.0)
+					WriteMappedFloatVariable(ObjectIdx, VariableName, OutNum);
+				else
+					WriteMappedIntVariable(ObjectIdx, VariableName, static_cast<int32>(OutNum));
 				continue;
 			}
 
 			FString OutStr;
 			if(Variable.Value->TryGetString(OutStr))
 			{
-				WorldState[ContextMapping.Key].StrVals.Emplace(VariableName, OutStr);
-				if(DSS)
-					DSS->UpdateStrValue(VariableName, OutStr);
+				WriteMappedStrVariable(ObjectIdx, VariableName, OutStr);
 				continue;
 			}
 		}
@@ -333,6 +347,9 @@ void UDialogueManagerSubsystem::UpdateWorldStateFromJSON(TSharedPtr<FJsonObject>
 		if(DSS)
 			DSS->OnDialogueComponentLoaded.Broadcast();
 	}
+
+	// Every changed variable has marked its own lines dirty, the unchanged ones keep their cached scores
+	BroadcastWorldStateChange();
 }
 
 void UDialogueManagerSubsystem::ClearAllSaveSlots() const
@@ -378,8 +395,20 @@ void UDialogueManagerSubsystem::Deinitialize()
 	
 	DSS_Components.Empty();
 	DialogueDataBase.Empty();
-	Categories.Empty();
+	CategoryIndex.Reset();
+	DenseLines.Empty();
+	LiveLines.Empty();
+	ParameterIndex.Reset();
+	DependencyGraph.Reset(0);
+	DatabaseVersion++;
+	ConditionTable.Reset();
+	Partitions.Reset();
+	LineCache.Empty();
+	FilterPassLines.Empty();
+	WorldStore.Reset();
+	WorldStoreSnapshot.Reset();
 	WorldState.Empty();
+	FDialogueClassDescriptor::Invalidate();
 }
 
 bool UDialogueManagerSubsystem::ShouldCreateSubsystem(UObject* Outer) const
@@ -392,9 +421,32 @@ bool UDialogueManagerSubsystem::ShouldCreateSubsystem(UObject* Outer) const
 
 void UDialogueManagerSubsystem::GetLinesForCurrentContext(
 	const int NoLines,
-	TArray<FQueryCategory> QueryCategories,
-	TMap<FString, FString> RequiredParameters,
-	TMap<FString, FString> ExcludedParameters,
+	const TArray<FQueryCategory>& QueryCategories,
+	const TMap<FString, FString>& RequiredParameters,
+	const TMap<FString, FString>& ExcludedParameters,
+	bool ProcessCallbacks,
+	TArray<UContextualDialogueLine*>& OutLines,
+	bool& RequestedNumOfLinesFound,
+	int& ActualNumOfLinesFound,
+	EDialogueCategoryMatch CategoryMatch)
+{
+	// Poll the world state
+	UpdateWorldState();
+
+	FDialogueBitSet& Candidates = QueryScratch.Candidates;
+	BuildCandidates(QueryCategories, CategoryMatch, RequiredParameters, ExcludedParameters, Candidates);
+
+	RunCandidateQuery(Candidates, NoLines, ProcessCallbacks, OutLines);
+
+	RequestedNumOfLinesFound = NoLines == OutLines.Num();
+	ActualNumOfLinesFound = OutLines.Num();
+}
+
+void UDialogueManagerSubsystem::GetLinesForTagQuery(
+	const int NoLines,
+	const FGameplayTagQuery& TagQuery,
+	const TMap<FString, FString>& RequiredParameters,
+	const TMap<FString, FString>& ExcludedParameters,
 	bool ProcessCallbacks,
 	TArray<UContextualDialogueLine*>& OutLines,
 	bool& RequestedNumOfLinesFound,
@@ -403,194 +455,436 @@ void UDialogueManagerSubsystem::GetLinesForCurrentContext(
 	// Poll the world state
 	UpdateWorldState();
 
-	FMultipleLineScoring ScoringStruct(NoLines);
+	FDialogueBitSet& Candidates = QueryScratch.Candidates;
+	BuildCandidates(TArray<FQueryCategory>(), EDialogueCategoryMatch::AnyOf, RequiredParameters, ExcludedParameters, Candidates);
 
-	// First filter out the database to only contain lines whose Filter conditions are met
-	FDialogueDB FilteredDB = DialogueDataBase.FilterByPredicate(
-		[&](UContextualDialogueLine* Line)
+	// A tag query is an arbitrary expression, so it is checked line by line on whatever the indexed stages left over
+	if (!TagQuery.IsEmpty())
+	{
+		Candidates.ForEachSetBit([&](const int32 LineIdx)
 		{
-			for (FDialogueCondition& Condition : Line->Filters)
-			{
-				// If at least one of filters is not fulfilled - don't add the line
-				if (!IsConditionFulfilled(Condition))
-					return false;
-			}
-
-			// If all of the conditions passed, then we're all good
-			return true;
+			if (!TagQuery.Matches(DenseLines[LineIdx]->CategoryTags))
+				Candidates.Clear(LineIdx);
 		});
+	}
+
+	RunCandidateQuery(Candidates, NoLines, ProcessCallbacks, OutLines);
+
+	RequestedNumOfLinesFound = NoLines == OutLines.Num();
+	ActualNumOfLinesFound = OutLines.Num();
+}
+
+FString UDialogueManagerSubsystem::ExplainQuery(
+	const TArray<FQueryCategory>& QueryCategories,
+	const TMap<FString, FString>& RequiredParameters,
+	const TMap<FString, FString>& ExcludedParameters,
+	EDialogueCategoryMatch CategoryMatch)
+{
+	// Poll the world state, the plan depends on it
+	UpdateWorldState();
+
+	FDialogueBitSet& Candidates = QueryScratch.Candidates;
+	FDialogueQueryPlan Plan;
+	BuildCandidates(QueryCategories, CategoryMatch, RequiredParameters, ExcludedParameters, Candidates, nullptr, &Plan);
+
+	return Plan.ToString();
+}
 
-	TArray<UContextualDialogueLine*> LineCandidates;
+FDialoguePreparedQuery UDialogueManagerSubsystem::PrepareQuery(
+	const int NoLines,
+	const TArray<FQueryCategory>& QueryCategories,
+	const TMap<FString, FString>& RequiredParameters,
+	const TMap<FString, FString>& ExcludedParameters,
+	EDialogueCategoryMatch CategoryMatch)
+{
+	FDialoguePreparedQuery Query;
+	Query.NoLines = NoLines;
+	Query.QueryCategories = QueryCategories;
+	Query.CategoryMatch = CategoryMatch;
+	Query.RequiredParameters = RequiredParameters;
+	Query.ExcludedParameters = ExcludedParameters;
+
+	BuildStaticCandidates(QueryCategories, CategoryMatch, RequiredParameters, ExcludedParameters, Query.Candidates);
+	Query.DatabaseVersion = DatabaseVersion;
+
+	return Query;
+}
 
-	// Keep the lines that has all the Required Parameters and none of the exclude parameters
-	for (auto Line : FilteredDB)
+void UDialogueManagerSubsystem::ExecutePreparedQuery(
+	FDialoguePreparedQuery& Query,
+	bool ProcessCallbacks,
+	TArray<UContextualDialogueLine*>& OutLines,
+	bool& RequestedNumOfLinesFound,
+	int& ActualNumOfLinesFound)
+{
+	if (!IsPreparedQueryValid(Query))
 	{
-		bool IsCandidate = true;
+		UE_LOG(DialogueManagerSubsystem, Verbose, TEXT("[DIALOGUE] Prepared query is out of date, preparing it again"))
+		Query = PrepareQuery(Query.NoLines, Query.QueryCategories, Query.RequiredParameters, Query.ExcludedParameters,
+		                     Query.CategoryMatch);
+	}
+
+	// Poll the world state
+	UpdateWorldState();
+
+	// Lines deleted since the query was prepared drop out here
+	FDialogueBitSet& Candidates = QueryScratch.Candidates;
+	Candidates.CopyFrom(Query.Candidates);
+	Candidates.And(LiveLines);
+	ApplyWorldStages(Candidates);
+
+	RunCandidateQuery(Candidates, Query.NoLines, ProcessCallbacks, OutLines);
 
-		// Required Parameters
-		for (auto Parameter : RequiredParameters)
+	RequestedNumOfLinesFound = Query.NoLines == OutLines.Num();
+	ActualNumOfLinesFound = OutLines.Num();
+}
+
+bool UDialogueManagerSubsystem::IsPreparedQueryValid(const FDialoguePreparedQuery& Query) const
+{
+	return Query.DatabaseVersion == DatabaseVersion && Query.Candidates.Num() == DenseLines.Num();
+}
+
+void UDialogueManagerSubsystem::RunCandidateQuery(FDialogueBitSet& Candidates, const int32 NoLines, bool ProcessCallbacks,
+                                                  TArray<UContextualDialogueLine*>& OutLines)
+{
+	SelectBestLines(Candidates, NoLines);
+
+	const TArray<int32>& BestLineIndices = QueryScratch.BestLineIndices;
+	OutLines.Reset(BestLineIndices.Num());
+	for (const int32 LineIdx : BestLineIndices)
+		OutLines.Add(DenseLines[LineIdx]);
+
+	if (ProcessCallbacks)
+	{
+		for (UContextualDialogueLine* SelectedLineOjb : OutLines)
 		{
-			if (Line->Parameters.Contains(Parameter.Key))
-			{
-				if (Line->Parameters[Parameter.Key] != Parameter.Value && Parameter.Value != "*")
-				{
-					IsCandidate = false;
-				}
-			}
-			else
-			{
-				IsCandidate = false;
-			}
+			UE_LOG(DialogueManagerSubsystem, Warning, TEXT("PROCESSING LINE MAPPINGS"))
+			ProcessLineCallbacks(SelectedLineOjb);
 		}
+	}
+}
+
+void UDialogueManagerSubsystem::SelectBestLines(FDialogueBitSet& Candidates, const int32 NoLines)
+{
+	// Filters and conditions are only re-evaluated for the lines whose variables changed since they were last scored
+	FDialogueTopKSelector& TopK = QueryScratch.TopK;
+	TopK.Reset(NoLines, Candidates.CountSetBits());
+	ScoreCandidates(Candidates, TopK);
+
+#if WITH_EDITOR
+	Candidates.And(FilterPassLines);
+	BroadcastQueryDebugCapture(Candidates);
+#endif
+
+	TopK.GetSortedLineIndices(QueryScratch.BestLineIndices);
+}
+
+TFuture<TArray<UContextualDialogueLine*>> UDialogueManagerSubsystem::GetLinesForCurrentContextAsync(
+	const int NoLines,
+	const TArray<FQueryCategory>& QueryCategories,
+	const TMap<FString, FString>& RequiredParameters,
+	const TMap<FString, FString>& ExcludedParameters,
+	bool ProcessCallbacks,
+	FOnDialogueAsyncQueryCompleted OnCompleted,
+	EDialogueCategoryMatch CategoryMatch)
+{
+	check(IsInGameThread());
 
-		// Excluded Parameters
-		for (auto Parameter : ExcludedParameters)
+	// Poll the world state and run the index stages right away, they are cheap and need the game thread anyway
+	UpdateWorldState();
+
+	FDialogueBitSet Candidates;
+	BuildCandidates(QueryCategories, CategoryMatch, RequiredParameters, ExcludedParameters, Candidates);
+
+	// The worker only ever sees an immutable snapshot of the World State and weak references to the lines, so it never
+	// races with the game thread. The score cache is left alone as well - the lines are evaluated from scratch against
+	// the snapshot. The variables of the candidates are bound already, so their slots are part of the snapshot
+	TArray<TWeakObjectPtr<UContextualDialogueLine>> CandidateLines;
+	CandidateLines.Reserve(Candidates.CountSetBits());
+	Candidates.ForEachSetBit([&](const int32 LineIdx) { CandidateLines.Add(DenseLines[LineIdx]); });
+
+	TSharedRef<TPromise<TArray<UContextualDialogueLine*>>> Promise = MakeShared<TPromise<TArray<UContextualDialogueLine*>>>();
+	TFuture<TArray<UContextualDialogueLine*>> Future = Promise->GetFuture();
+
+	UE::Tasks::Launch(UE_SOURCE_LOCATION,
+		[WeakThis = TWeakObjectPtr<UDialogueManagerSubsystem>(this), State = GetWorldStoreSnapshot(), CandidateLines = MoveTemp(CandidateLines),
+		 NoLines, ProcessCallbacks, OnCompleted = MoveTemp(OnCompleted), Promise]() mutable
 		{
-			if (Line->Parameters.Contains(Parameter.Key))
+			// Lines are indexed by their position in the snapshot, which keeps the database order for ties
+			FDialogueTopKSelector TopK(NoLines, CandidateLines.Num());
 			{
-				if (Line->Parameters[Parameter.Key] == Parameter.Value || Parameter.Value == "*")
+				// Keep the lines from being collected while they are being read
+				FGCScopeGuard GCGuard;
+				for (int32 SnapshotIdx = 0; SnapshotIdx < CandidateLines.Num(); SnapshotIdx++)
 				{
-					IsCandidate = false;
+					const UContextualDialogueLine* Line = CandidateLines[SnapshotIdx].Get();
+					if (Line && AreFiltersFulfilled(Line, *State))
+						TopK.Add(GetLineScore(Line, *State), SnapshotIdx);
 				}
 			}
-		}
 
-		if (IsCandidate)
-		{
-			LineCandidates.Add(Line);
-		}
-	}
+			TArray<int32> BestSnapshotIndices;
+			TopK.GetSortedLineIndices(BestSnapshotIndices);
 
-#if WITH_EDITOR
-	TArray<UContextualDialogueLine*> DebugLines;
-	TArray<FLineScore> DebugScores;
-#endif
+			AsyncTask(ENamedThreads::GameThread,
+				[WeakThis, CandidateLines = MoveTemp(CandidateLines), BestSnapshotIndices = MoveTemp(BestSnapshotIndices),
+				 ProcessCallbacks, OnCompleted = MoveTemp(OnCompleted), Promise]()
+				{
+					TArray<UContextualDialogueLine*> OutLines;
+
+					if (UDialogueManagerSubsystem* This = WeakThis.Get())
+					{
+						OutLines.Reserve(BestSnapshotIndices.Num());
+						for (const int32 SnapshotIdx : BestSnapshotIndices)
+						{
+							// Skip lines that got deleted from the database while the query was running
+							UContextualDialogueLine* Line = CandidateLines[SnapshotIdx].Get();
+							if (Line && This->DenseLines.IsValidIndex(Line->DenseIndex) && This->DenseLines[Line->DenseIndex] == Line)
+								OutLines.Add(Line);
+						}
+
+						if (ProcessCallbacks)
+						{
+							for (UContextualDialogueLine* SelectedLineOjb : OutLines)
+								This->ProcessLineCallbacks(SelectedLineOjb);
+						}
+					}
+
+					Promise->SetValue(OutLines);
+					OnCompleted.ExecuteIfBound(OutLines);
+				});
+		});
+
+	return Future;
+}
+
+void UDialogueManagerSubsystem::GetBestLine(const TArray<FQueryCategory>& QueryCategories,
+                                            const TMap<FString, FString>& RequiredParameters,
+                                            const TMap<FString, FString>& ExcludedParameters, bool ProcessCallbacks,
+                                            bool& FoundLine, UContextualDialogueLine*& Line,
+                                            EDialogueCategoryMatch CategoryMatch)
+{
+	// Poll the world state
+	UpdateWorldState();
+
+	// Same as a query for a single line, minus the output array
+	FDialogueBitSet& Candidates = QueryScratch.Candidates;
+	BuildCandidates(QueryCategories, CategoryMatch, RequiredParameters, ExcludedParameters, Candidates);
+	SelectBestLines(Candidates, 1);
 
-	if (QueryCategories.Num() > 0)
+	FoundLine = QueryScratch.BestLineIndices.Num() > 0;
+	Line = FoundLine ? DenseLines[QueryScratch.BestLineIndices[0]] : nullptr;
+
+	if (ProcessCallbacks && Line)
 	{
-		for (FQueryCategory Category : QueryCategories)
-		{
-			if (!Categories.Contains(Category.CategoryName) || !Categories.Find(Category.CategoryName)->Contains(
-				Category.CategoryValue))
-				continue;
+		UE_LOG(DialogueManagerSubsystem, Warning, TEXT("PROCESSING LINE MAPPINGS"))
+		ProcessLineCallbacks(Line);
+	}
+}
 
-			for (auto Line : *Categories.Find(Category.CategoryName)->Find(Category.CategoryValue))
-			{
-				if (!LineCandidates.Contains(Line)) continue; // TODO: optimize this
-				FLineScore LineScore = GetLineScore(Line);
-				ScoringStruct.CheckAndAddLine(Line, LineScore);
+void UDialogueManagerSubsystem::GetLinesForSpeakers(const TArray<FDialogueQueryDescriptor>& Queries, bool ProcessCallbacks,
+                                                    TArray<FDialogueQueryResult>& OutResults)
+{
+	OutResults.Reset();
+	OutResults.SetNum(Queries.Num());
+	if (Queries.Num() == 0)
+		return;
 
-#if WITH_EDITOR
-				DebugLines.Add(Line);
-				DebugScores.Add(LineScore);
-#endif
-			}
-		}
+	// Poll the world state, once for the whole batch
+	UpdateWorldState();
+
+	// Lines reading the speaker are the only ones whose results differ between the queries, so they can't be pruned
+	// by the partitions of the current speaker either
+	FDialogueBitSet& SpeakerLines = QueryScratch.SpeakerLines;
+	DependencyGraph.BuildVariableMask("World", "Speaker", SpeakerLines);
+
+	// Everything the batch works with comes from the scratch, so crowd scenes batching every frame don't allocate
+	TArray<FDialogueBitSet>& QueryCandidates = QueryScratch.QueryCandidates;
+	if (QueryCandidates.Num() < Queries.Num())
+		QueryCandidates.SetNum(Queries.Num());
+	FDialogueBitSet& SpeakerCandidates = QueryScratch.SpeakerCandidates;
+	SpeakerCandidates.Init(DenseLines.Num(), false);
+	for (int32 QueryIdx = 0; QueryIdx < Queries.Num(); QueryIdx++)
+	{
+		const FDialogueQueryDescriptor& Query = Queries[QueryIdx];
+		BuildCandidates(Query.QueryCategories, Query.CategoryMatch, Query.RequiredParameters, Query.ExcludedParameters,
+		                QueryCandidates[QueryIdx], &SpeakerLines);
+		SpeakerCandidates.Or(QueryCandidates[QueryIdx]);
 	}
+	SpeakerCandidates.And(SpeakerLines);
 
-	else
+	auto IsSpeakerCondition = [](const FDialogueCondition& Condition)
 	{
-		for (UContextualDialogueLine* Line : FilteredDB)
-		{
-			if (!LineCandidates.Contains(Line)) continue; // TODO: optimize this
-			FLineScore LineScore = GetLineScore(Line);
-			ScoringStruct.CheckAndAddLine(Line, LineScore);
+		return Condition.IsValidReference && Condition.ObjectId == "World" && Condition.VariableId == "Speaker";
+	};
 
-#if WITH_EDITOR
-			DebugLines.Add(Line);
-			DebugScores.Add(LineScore);
-#endif
-		}
-	}
+	// The query's speaker stands in for the string value of "World.Speaker", so the World State is never touched.
+	// Only string literals read that value (case-insensitively, like the names they are compiled into), numeric ones
+	// are evaluated against the store as usual
+	auto IsSpeakerConditionFulfilled = [this](const FDialogueCondition& Condition, const FString& Speaker)
+	{
+		if (Condition.LiteralType != EDialogueLiteralType::String)
+			return IsConditionFulfilled(Condition);
 
-#if WITH_EDITOR
-	OnDialogueQueryFinished.Broadcast(DebugScores, DebugLines);
-#endif
+		return Condition.ConditionType == EQUAL && Speaker.Equals(Condition.ValueToCompare, ESearchCase::IgnoreCase);
+	};
 
-	TArray<UContextualDialogueLine*> OutArray;
-	ScoringStruct.GetNBestResults(NoLines, OutArray);
+	// Evaluate everything but the speaker conditions of those lines once, in the order the bits are visited
+	RefreshConditionTable();
 
-	if (ProcessCallbacks)
+	TArray<FDialogueSpeakerPartialScore>& PartialScores = QueryScratch.PartialScores;
+	PartialScores.Reset();
+	PartialScores.Reserve(SpeakerCandidates.CountSetBits());
+	SpeakerCandidates.ForEachSetBit([&](const int32 LineIdx)
 	{
-		for (UContextualDialogueLine* SelectedLineOjb : OutArray)
+		const UContextualDialogueLine* Line = DenseLines[LineIdx];
+		FDialogueSpeakerPartialScore& Partial = PartialScores.AddDefaulted_GetRef();
+
+		for (const FDialogueCondition& Condition : Line->Filters)
 		{
-			UE_LOG(DialogueManagerSubsystem, Warning, TEXT("PROCESSING LINE MAPPINGS"))
-			ProcessLineCallbacks(SelectedLineOjb);
+			if (!IsSpeakerCondition(Condition) && !ConditionTable.IsFulfilled(Condition.TableId))
+				Partial.bRejected = true;
 		}
-	}
 
-	OutLines = OutArray;
-	RequestedNumOfLinesFound = NoLines == OutArray.Num();
-	ActualNumOfLinesFound = OutArray.Num();
-}
+		for (const FDialogueCondition& Condition : Line->Conditions)
+		{
+			if (IsSpeakerCondition(Condition))
+				continue;
 
-void UDialogueManagerSubsystem::GetBestLine(TArray<FQueryCategory> QueryCategories,
-                                            TMap<FString, FString> RequiredParameters,
-                                            TMap<FString, FString> ExcludedParameters, bool ProcessCallbacks,
-                                            bool& FoundLine, UContextualDialogueLine*& Line)
-{
-	TArray<UContextualDialogueLine*> OutLines;
-	int ActualNumOfLinesFound;
-	
-	GetLinesForCurrentContext(1, QueryCategories, RequiredParameters, ExcludedParameters, ProcessCallbacks, OutLines,
-	                          FoundLine, ActualNumOfLinesFound);
+			if (ConditionTable.IsFulfilled(Condition.TableId))
+				Partial.NumMatched++;
+			else if (Condition.IsCritical)
+				Partial.bRejected = true;
+		}
+	});
 
-	Line = FoundLine ? OutLines[0] : nullptr;
-}
+	FDialogueBitSet& SharedCandidates = QueryScratch.SharedCandidates;
+	FDialogueTopKSelector& TopK = QueryScratch.TopK;
+	for (int32 QueryIdx = 0; QueryIdx < Queries.Num(); QueryIdx++)
+	{
+		const FDialogueQueryDescriptor& Query = Queries[QueryIdx];
+		const FDialogueBitSet& Candidates = QueryCandidates[QueryIdx];
+		TopK.Reset(Query.NoLines, Candidates.CountSetBits());
 
-bool UDialogueManagerSubsystem::GetLinesWithParametersForCurrentContext(
-	TArray<FQueryCategory> QueryCategories,
-	TMap<FString, FString> Parameters,
-	TArray<UContextualDialogueLine*>& OutLines)
-{
-	// Get the lines of current context
-	TArray<UContextualDialogueLine*> LinesInContext;
-	bool AllLinesFound;
-	int NLinesFound;
-	TMap<FString, FString> p;
-	TMap<FString, FString> ep;
-	GetLinesForCurrentContext(
-		9999,
-		QueryCategories,
-		p,
-		ep,
-		false,
-		LinesInContext,
-		AllLinesFound,
-		NLinesFound);
-
-	// Get only the one with the desired parameters.
-	TArray<UContextualDialogueLine*> LineCandidates;
-	for (auto Line : LinesInContext)
-	{
-		bool IsCandidate = true;
-		for (auto Parameter : Parameters)
+		// Speaker independent lines come from the line cache, so they are only ever scored by the first query needing them
+		SharedCandidates.CopyFrom(Candidates);
+		SharedCandidates.AndNot(SpeakerLines);
+		ScoreCandidates(SharedCandidates, TopK);
+
+		int32 PartialIdx = 0;
+		SpeakerCandidates.ForEachSetBit([&](const int32 LineIdx)
 		{
-			if (Line->Parameters.Contains(Parameter.Key))
+			const FDialogueSpeakerPartialScore& Partial = PartialScores[PartialIdx++];
+			if (Partial.bRejected || !Candidates.Test(LineIdx))
+				return;
+
+			const UContextualDialogueLine* Line = DenseLines[LineIdx];
+			for (const FDialogueCondition& Condition : Line->Filters)
 			{
-				if (Line->Parameters[Parameter.Key] != Parameter.Value)
-				{
-					IsCandidate = false;
-				}
+				if (IsSpeakerCondition(Condition) && !IsSpeakerConditionFulfilled(Condition, Query.Speaker))
+					return;
 			}
-			else
+
+			int32 NumMatched = Partial.NumMatched;
+			for (const FDialogueCondition& Condition : Line->Conditions)
 			{
-				IsCandidate = false;
+				if (!IsSpeakerCondition(Condition))
+					continue;
+
+				if (IsSpeakerConditionFulfilled(Condition, Query.Speaker))
+					NumMatched++;
+				else if (Condition.IsCritical)
+					return;
 			}
+
+			TopK.Add({static_cast<float>(NumMatched) / Line->Conditions.Num(), Line->Conditions.Num()}, LineIdx);
+		});
+
+		TArray<int32>& BestLineIndices = QueryScratch.BestLineIndices;
+		TopK.GetSortedLineIndices(BestLineIndices);
+
+		TArray<UContextualDialogueLine*>& OutLines = OutResults[QueryIdx].Lines;
+		OutLines.Reserve(BestLineIndices.Num());
+		for (const int32 LineIdx : BestLineIndices)
+			OutLines.Add(DenseLines[LineIdx]);
+	}
+
+	if (ProcessCallbacks)
+	{
+		for (const FDialogueQueryResult& Result : OutResults)
+		{
+			for (UContextualDialogueLine* SelectedLineOjb : Result.Lines)
+				ProcessLineCallbacks(SelectedLineOjb);
 		}
-		if (IsCandidate)
+	}
+}
+
+bool UDialogueManagerSubsystem::GetLinesWithParametersForCurrentContext(
+	TArray<FQueryCategory> QueryCategories,
+	TMap<FString, FString> Parameters,
+	TArray<UContextualDialogueLine*>& OutLines,
+	EDialogueCategoryMatch CategoryMatch)
+{
+	OutLines.Reset();
+
+	// Poll the world state
+	UpdateWorldState();
+	RefreshConditionTable();
+
+	// Start from the lines having the parameters and categories, so that the cost follows the number of matches rather
+	// than the DB. Both are sorted posting lists, so combining them is a single linear merge
+	FDialoguePostingList& Matches = QueryScratch.ParameterMatches;
+	if (Parameters.Num() > 0)
+	{
+		ParameterIndex.Resolve(Parameters, TMap<FString, FString>(), Matches);
+		if (QueryCategories.Num() > 0)
 		{
-			LineCandidates.Add(Line);
+			FDialoguePostingList& CategoryLines = QueryScratch.CategoryMatches;
+			FDialoguePostingList& Intersection = QueryScratch.MergedMatches;
+			CategoryIndex.Resolve(QueryCategories, CategoryMatch, CategoryLines);
+			FDialoguePostingListUtils::Intersect(Matches, CategoryLines, Intersection);
+			Swap(Matches, Intersection);
 		}
 	}
+	else if (QueryCategories.Num() > 0)
+	{
+		CategoryIndex.Resolve(QueryCategories, CategoryMatch, Matches);
+	}
+	else
+	{
+		Matches.Reset();
+		Matches.Reserve(LiveLines.CountSetBits());
+		LiveLines.ForEachSetBit([&](const int32 LineIdx) { Matches.Add(LineIdx); });
+	}
 
-	OutLines = LineCandidates;
+	// Every matching line is wanted, so there is no top-K here - just the keys of all the lines worth returning
+	const uint64 Version = DependencyGraph.GetVersion();
+	const FDialogueBitSet& DirtyLines = DependencyGraph.GetDirtyLines();
 
-	if (OutLines.Num() > 0)
+	TArray<uint64>& Keys = QueryScratch.LineKeys;
+	Keys.Reset();
+	Keys.Reserve(Matches.Num());
+	for (const int32 LineIdx : Matches)
 	{
-		return true;
+		if (!LiveLines.Test(LineIdx))
+			continue;
+
+		if (DirtyLines.Test(LineIdx))
+			RefreshLine(LineIdx, Version, 0);
+
+		const FLineScore& Score = LineCache[LineIdx].Score;
+		if (FilterPassLines.Test(LineIdx) && Score.Score > 0.0f)
+			Keys.Add(FDialogueTopKSelector::PackKey(Score, LineIdx));
 	}
-	return false;
+
+	// Same order GetLinesForCurrentContext() returns its lines in
+	Keys.Sort();
+
+	OutLines.Reserve(Keys.Num());
+	for (const uint64 Key : Keys)
+		OutLines.Add(DenseLines[FDialogueTopKSelector::UnpackLineIndex(Key)]);
+
+	return OutLines.Num() > 0;
 }
 
 void UDialogueManagerSubsystem::DialogueLineSelected(UContextualDialogueLine* Line)
@@ -621,180 +915,922 @@ bool UDialogueManagerSubsystem::DeleteLineFromDataBase(UContextualDialogueLine*
 	DialogueDataBase.Remove(LinePtr);
 	DialogueLookup.Remove(Line->UniqueName);
 
+	RemoveLineFromIndices(LinePtr);
+
 	return true;
 }
 
-void UDialogueManagerSubsystem::ProcessSingleLineCallbacks(UContextualDialogueLine* Line)
+void UDialogueManagerSubsystem::AddLineToIndices(UContextualDialogueLine* Line)
 {
-	ProcessLineCallbacks(Line);
-}
+	Line->DenseIndex = DenseLines.Add(Line);
+	checkf(Line->DenseIndex <= FDialogueTopKSelector::MaxLineIndex, TEXT("[DIALOGUE] Too many dialogue lines loaded: %i"), DenseLines.Num());
+	LiveLines.SetNum(DenseLines.Num());
+	LiveLines.Set(Line->DenseIndex);
 
-// TODO: Probably template the whole shit with type of the variable ( ͡° ͜ʖ ͡°)
-FLineScore UDialogueManagerSubsystem::GetLineScore(UContextualDialogueLine* Line) const
-{
-	float TotalScore = 0;
+	LineCache.AddDefaulted();
+	FilterPassLines.SetNum(DenseLines.Num());
 
 	for (FDialogueCondition& Condition : Line->Conditions)
 	{
-		const bool IsFulfilled = IsConditionFulfilled(Condition);
+		BindCondition(Condition);
+		ConditionTable.Intern(Condition, DependencyGraph);
+	}
+	for (FDialogueCondition& Condition : Line->Filters)
+	{
+		BindCondition(Condition);
+		ConditionTable.Intern(Condition, DependencyGraph);
+	}
 
-		// If not fulfilled and critical - return the whole score as 0
-		if (!IsFulfilled && Condition.IsCritical)
-			return {0.0f, Line->Conditions.Num()};
+	ParameterIndex.AddLine(Line);
+	for (const FGameplayTag& Tag : Line->CategoryTags)
+		CategoryIndex.AddLineTag(Line->DenseIndex, Tag);
+	DependencyGraph.AddLine(Line);
+	Partitions.AddLine(Line);
+}
 
-		TotalScore += IsFulfilled ? 1 : 0;
-	}
+void UDialogueManagerSubsystem::BindCondition(FDialogueCondition& Condition)
+{
+	if (!Condition.IsValidReference)
+		return;
 
-	return {TotalScore / Line->Conditions.Num(), Line->Conditions.Num()};
+	// Resolved here, once, rather than by name on every evaluation
+	Condition.VariableRef = WorldStore.BindVariable(Condition.ObjectId, Condition.VariableId);
+	if (Condition.LiteralType == EDialogueLiteralType::String)
+		Condition.LiteralStrId = WorldStore.InternStrLiteral(Condition.ValueToCompare);
+}
+
+void UDialogueManagerSubsystem::RemoveLineFromIndices(UContextualDialogueLine* Line)
+{
+	// The dense index is kept, the line simply stops being live
+	if (!DenseLines.IsValidIndex(Line->DenseIndex) || DenseLines[Line->DenseIndex] != Line)
+		return;
+
+	DenseLines[Line->DenseIndex] = nullptr;
+	LiveLines.Clear(Line->DenseIndex);
+	FilterPassLines.Clear(Line->DenseIndex);
+
+	ParameterIndex.RemoveLine(Line);
+	CategoryIndex.RemoveLine(Line->DenseIndex);
+	DependencyGraph.RemoveLine(Line);
+	Partitions.RemoveLine(Line);
 }
 
-bool UDialogueManagerSubsystem::IsConditionFulfilled(FDialogueCondition& Condition) const
+void UDialogueManagerSubsystem::RefreshConditionTable()
 {
-	// TODO: For now just assume correctness
-	TArray<FString> Keys;
-	Condition.VariableToCheck.ParseIntoArray(Keys, TEXT("."));
-	if (IsStringANumber(Condition.ValueToCompare))
+	auto ReadInt = [this](const FDialogueVariableRef& Ref, int32& OutValue, bool& bOutFraction)
 	{
-		bool IsFulfilled = false;
+		return WorldStore.ReadWhole(Ref, OutValue, bOutFraction);
+	};
 
-		// Only check conditions if the objects actually exist
-		if (WorldState.Contains(Keys[0]) && WorldState[Keys[0]].IntVals.Contains(Keys[1]))
-		{
-			const int VarValue = WorldState[Keys[0]].IntVals[Keys[1]];
-			const int ValueToCompareAgainst = FCString::Atoi(*Condition.ValueToCompare);
+	auto Evaluate = [this](const FDialogueCondition& Condition)
+	{
+		return IsConditionFulfilled(Condition);
+	};
 
-			switch (Condition.ConditionType)
-			{
-			case EQUAL:
-				IsFulfilled = VarValue == ValueToCompareAgainst;
-				break;
-			case GT:
-				IsFulfilled = VarValue > ValueToCompareAgainst;
-				break;
-			case LT:
-				IsFulfilled = VarValue < ValueToCompareAgainst;
-				break;
-			case GET:
-				IsFulfilled = VarValue >= ValueToCompareAgainst;
-				break;
-			case LET:
-				IsFulfilled = VarValue <= ValueToCompareAgainst;
-				break;
-			default:
-				break;
-			}
-		}
+	ConditionTable.Refresh(DependencyGraph, ReadInt, Evaluate);
+}
+
+bool UDialogueManagerSubsystem::RefreshLine(const int32 LineIdx, const uint64 Version, const uint64 Threshold)
+{
+	const UContextualDialogueLine* Line = DenseLines[LineIdx];
+	FDialogueLineCacheEntry& Entry = LineCache[LineIdx];
+	const int32 NumConditions = Line->Conditions.Num();
 
-		Condition.IsMatched = IsFulfilled;
-		return IsFulfilled;
+	if (!ConditionTable.AreAllFulfilled(Line->Filters))
+	{
+		FilterPassLines.Clear(LineIdx);
+		Entry.Score = {0.0f, NumConditions};
 	}
 	else
 	{
-		bool IsFulfilled = false;
+		int32 NumFulfilled = 0;
+		int32 NumRemaining = NumConditions;
+		bool bCriticalFailed = false;
 
-		if (WorldState.Contains(Keys[0]))
+		for (const FDialogueCondition& Condition : Line->Conditions)
 		{
-			FString VarValue;
-			if (!WorldState[Keys[0]].StrVals.Contains(Keys[1]))
-				VarValue = "";
-			else
-				VarValue = WorldState[Keys[0]].StrVals[Keys[1]];
-			switch (Condition.ConditionType)
+			// Give up as soon as the conditions left can't lift the line above the threshold. The line stays dirty,
+			// so its half-done result never makes it into the cache
+			const float BestPossible = static_cast<float>(NumFulfilled + NumRemaining) / NumConditions;
+			if (FDialogueTopKSelector::PackKey({BestPossible, NumConditions}, LineIdx) <= Threshold)
+				return false;
+
+			NumRemaining--;
+			const bool bFulfilled = ConditionTable.IsFulfilled(Condition.TableId);
+
+			// If not fulfilled and critical - the whole score is 0
+			if (!bFulfilled && Condition.IsCritical)
 			{
-			case EQUAL:
-				IsFulfilled = VarValue == Condition.ValueToCompare;
-				break;
-			case GT:
-			case LT:
-			case GET:
-			case LET:
-			default:
+				bCriticalFailed = true;
 				break;
 			}
+
+			NumFulfilled += bFulfilled ? 1 : 0;
 		}
 
-		Condition.IsMatched = IsFulfilled;
-		return IsFulfilled;
+		FilterPassLines.Set(LineIdx);
+		Entry.Score = {bCriticalFailed ? 0.0f : static_cast<float>(NumFulfilled) / NumConditions, NumConditions};
 	}
+
+	Entry.Version = Version;
+	DependencyGraph.GetDirtyLines().Clear(LineIdx);
+	return true;
 }
 
-void UDialogueManagerSubsystem::AddDialogueComponentToWorldState(UDialogueContextComponent* ContextComponent)
+void UDialogueManagerSubsystem::ScoreCandidates(const FDialogueBitSet& Candidates, FDialogueTopKSelector& OutTopK)
 {
-	if (WorldState.Contains(ContextComponent->DSS_Name) || !IsValid(ContextComponent))
-		return;
+	// Distinct conditions are evaluated up front, lines are then scored from their bits only
+	RefreshConditionTable();
 
-	FObjectValueMapping ContextMapping;
-	ContextMapping.Name = ContextComponent->DSS_Name;
-	ContextMapping.IntVals = ContextComponent->GetIntVars();
-	ContextMapping.StrVals = ContextComponent->GetStrVars();
-	ContextMapping.CallbackNames = ContextComponent->GetCallbackNames();
-	ContextMapping.IsMappedToActor = true;
-	ContextMapping.ContextRef = ContextComponent;
+	const FDialogueBitSet& DirtyLines = DependencyGraph.GetDirtyLines();
+	const uint64 Version = DependencyGraph.GetVersion();
 
-	WorldState.Add(ContextComponent->DSS_Name, ContextMapping);
-}
+	// Lines that can't make it into the top-K are left dirty, unless the debug widget wants to see every score
+	bool bPrune = true;
+#if WITH_EDITOR
+	bPrune = !OnDialogueQueryFinished.IsBound();
+#endif
 
-void UDialogueManagerSubsystem::PopulateWorldState()
-{
-	// Add all the object components
-	for (UDialogueContextComponent* ContextComponent : DSS_Components)
+	// Cached lines cost nothing, so they go first - the fuller the top-K, the more dirty lines can be skipped
+	FDialogueBitSet& CleanCandidates = QueryScratch.CleanCandidates;
+	CleanCandidates.CopyFrom(Candidates);
+	CleanCandidates.AndNot(DirtyLines);
+	CleanCandidates.And(FilterPassLines);
+	CleanCandidates.ForEachSetBit([&](const int32 LineIdx)
 	{
-		AddDialogueComponentToWorldState(ContextComponent);
-	}
-
-	if (WorldState.Contains("World"))
-		return;
-
-	// Add global world state
-	FObjectValueMapping WorldMapping;
-	WorldMapping.Name = "World";
-	WorldMapping.IntVals = GetIntStateVariables();
-	WorldMapping.StrVals = GetStrStateVariables();
-	// No callbacks for world state.
-	WorldMapping.IsMappedToActor = true;
-	WorldMapping.ContextRef = this;
+		checkSlow(!DependencyGraph.IsLineStale(LineIdx, LineCache[LineIdx].Version));
+		OutTopK.Add(LineCache[LineIdx].Score, LineIdx);
+	});
 
-	WorldState.Add("World", WorldMapping);
+	FDialogueBitSet& DirtyCandidates = QueryScratch.DirtyCandidates;
+	DirtyCandidates.CopyFrom(Candidates);
+	DirtyCandidates.And(DirtyLines);
 
-	TArray<FObjectValueMapping> OutValues;
-	WorldState.GenerateValueArray(OutValues);
-	OnWorldStateUpdated.Broadcast(OutValues);
+	// Refresh the dirty lines within a range of words, best possible scores first, and offer them to the given top-K.
+	// A line's best possible score is all of its conditions fulfilled, so more conditions means a higher bound (see
+	// FLineScore's operator>) and lower dense indices win the ties - once a line can't beat the threshold, none of the
+	// lines after it can either
+	auto ScoreDirtyLines = [&](const int32 FirstWord, const int32 EndWord, FDialogueTopKSelector& TopK, const uint64 OuterThreshold,
+	                           TArray<int32>& Order)
+	{
+		Order.Reset();
+		DirtyCandidates.ForEachSetBitInWords(FirstWord, EndWord, [&](const int32 LineIdx) { Order.Add(LineIdx); });
+		if (bPrune)
+		{
+			Order.Sort([this](const int32 A, const int32 B)
+			{
+				const int32 NumA = DenseLines[A]->Conditions.Num();
+				const int32 NumB = DenseLines[B]->Conditions.Num();
+				return NumA == NumB ? A < B : NumA > NumB;
+			});
+		}
+
+		for (const int32 LineIdx : Order)
+		{
+			const uint64 Threshold = bPrune ? FMath::Max(TopK.GetThreshold(), OuterThreshold) : 0;
+			const int32 NumConditions = DenseLines[LineIdx]->Conditions.Num();
+			if (FDialogueTopKSelector::PackKey({1.0f, NumConditions}, LineIdx) <= Threshold)
+				break;
+
+			if (RefreshLine(LineIdx, Version, Threshold) && FilterPassLines.Test(LineIdx))
+				TopK.Add(LineCache[LineIdx].Score, LineIdx);
+		}
+	};
+
+	const int32 ParallelThreshold = GetDefault<UContextualDialogueSettings>()->ParallelScoringLineThreshold;
+	const int32 NumDirty = DirtyCandidates.CountSetBits();
+
+	TArray<TArray<int32>>& DirtyOrders = QueryScratch.DirtyOrders;
+	if (ParallelThreshold <= 0 || NumDirty < ParallelThreshold)
+	{
+		if (DirtyOrders.Num() == 0)
+			DirtyOrders.AddDefaulted();
+
+		ScoreDirtyLines(0, DirtyCandidates.NumWords(), OutTopK, 0, DirtyOrders[0]);
+	}
+	else
+	{
+		// Chunks are made of whole words, so no two workers ever write into the same word of FilterPassLines or of the
+		// dirty lines. Every chunk prunes against its own top-K as well as whatever the cached lines have already set
+		constexpr int32 WordsPerChunk = 16;
+		const int32 NumChunks = FMath::DivideAndRoundUp(DirtyCandidates.NumWords(), WordsPerChunk);
+		const uint64 CachedThreshold = OutTopK.GetThreshold();
+
+		// Only ever grown, so the per-chunk buffers survive queries over smaller dirty sets
+		TArray<FDialogueTopKSelector>& ChunkTopK = QueryScratch.ChunkTopK;
+		if (ChunkTopK.Num() < NumChunks)
+			ChunkTopK.SetNum(NumChunks);
+		if (DirtyOrders.Num() < NumChunks)
+			DirtyOrders.SetNum(NumChunks);
+
+		for (int32 ChunkIdx = 0; ChunkIdx < NumChunks; ChunkIdx++)
+			ChunkTopK[ChunkIdx].Reset(OutTopK.GetK(), WordsPerChunk * 64);
+
+		ParallelFor(NumChunks, [&](const int32 ChunkIdx)
+		{
+			const int32 FirstWord = ChunkIdx * WordsPerChunk;
+			const int32 EndWord = FMath::Min(FirstWord + WordsPerChunk, DirtyCandidates.NumWords());
+			ScoreDirtyLines(FirstWord, EndWord, ChunkTopK[ChunkIdx], CachedThreshold, DirtyOrders[ChunkIdx]);
+		});
+
+		for (int32 ChunkIdx = 0; ChunkIdx < NumChunks; ChunkIdx++)
+			OutTopK.Merge(ChunkTopK[ChunkIdx]);
+	}
+
+	// Refreshed lines have cleared their own dirty bits, the pruned ones wait for a query that actually needs them
 }
 
-void UDialogueManagerSubsystem::UpdateWorldState()
+#if WITH_EDITOR
+void UDialogueManagerSubsystem::BroadcastQueryDebugCapture(const FDialogueBitSet& ScoredLines) const
+{
+	if (!OnDialogueQueryFinished.IsBound())
+		return;
+
+	TArray<UContextualDialogueLine*> DebugLines;
+	TArray<FLineScore> DebugScores;
+	TArray<FDialogueLineMatchCapture> DebugMatches;
+
+	const int32 NumScored = ScoredLines.CountSetBits();
+	DebugLines.Reserve(NumScored);
+	DebugScores.Reserve(NumScored);
+	DebugMatches.Reserve(NumScored);
+
+	ScoredLines.ForEachSetBit([&](const int32 LineIdx)
+	{
+		UContextualDialogueLine* Line = DenseLines[LineIdx];
+
+		FDialogueLineMatchCapture& Matches = DebugMatches.AddDefaulted_GetRef();
+		Matches.ConditionsMatched.Reserve(Line->Conditions.Num());
+		for (const FDialogueCondition& Condition : Line->Conditions)
+			Matches.ConditionsMatched.Add(IsConditionFulfilled(Condition));
+
+		Matches.FiltersMatched.Reserve(Line->Filters.Num());
+		for (const FDialogueCondition& Condition : Line->Filters)
+			Matches.FiltersMatched.Add(IsConditionFulfilled(Condition));
+
+		DebugLines.Add(Line);
+		DebugScores.Add(LineCache[LineIdx].Score);
+	});
+
+	OnDialogueQueryFinished.Broadcast(DebugScores, DebugLines, DebugMatches);
+}
+#endif
+
+void UDialogueManagerSubsystem::BuildStaticCandidates(const TArray<FQueryCategory>& QueryCategories,
+                                                      const EDialogueCategoryMatch CategoryMatch,
+                                                      const TMap<FString, FString>& RequiredParameters,
+                                                      const TMap<FString, FString>& ExcludedParameters,
+                                                      FDialogueBitSet& OutCandidates) const
 {
+	FDialogueQueryPlan Plan;
+	PlanQueryStages(QueryCategories, CategoryMatch, RequiredParameters, ExcludedParameters, true, false, Plan);
+
+	OutCandidates.CopyFrom(LiveLines);
+	ExecuteQueryPlan(Plan, QueryCategories, CategoryMatch, RequiredParameters, ExcludedParameters, OutCandidates);
+}
+
+void UDialogueManagerSubsystem::ApplyWorldStages(FDialogueBitSet& Candidates, const FDialogueBitSet* UnprunedLines) const
+{
+	FDialogueQueryPlan Plan;
+	PlanQueryStages(TArray<FQueryCategory>(), EDialogueCategoryMatch::AnyOf, TMap<FString, FString>(), TMap<FString, FString>(),
+	                false, true, Plan);
+	ExecuteQueryPlan(Plan, TArray<FQueryCategory>(), EDialogueCategoryMatch::AnyOf, TMap<FString, FString>(),
+	                 TMap<FString, FString>(), Candidates, UnprunedLines);
+}
+
+void UDialogueManagerSubsystem::BuildCandidates(const TArray<FQueryCategory>& QueryCategories,
+                                                const EDialogueCategoryMatch CategoryMatch,
+                                                const TMap<FString, FString>& RequiredParameters,
+                                                const TMap<FString, FString>& ExcludedParameters,
+                                                FDialogueBitSet& OutCandidates,
+                                                const FDialogueBitSet* UnprunedLines,
+                                                FDialogueQueryPlan* OutPlan) const
+{
+	FDialogueQueryPlan Plan;
+	PlanQueryStages(QueryCategories, CategoryMatch, RequiredParameters, ExcludedParameters, true, true, Plan);
+
+	OutCandidates.CopyFrom(LiveLines);
+	ExecuteQueryPlan(Plan, QueryCategories, CategoryMatch, RequiredParameters, ExcludedParameters, OutCandidates, UnprunedLines);
+
+	UE_LOG(DialogueManagerSubsystem, VeryVerbose, TEXT("[DIALOGUE] Query plan: %s"), *Plan.ToString())
+
+	if (OutPlan)
+		*OutPlan = MoveTemp(Plan);
+}
+
+void UDialogueManagerSubsystem::PlanQueryStages(const TArray<FQueryCategory>& QueryCategories,
+                                                const EDialogueCategoryMatch CategoryMatch,
+                                                const TMap<FString, FString>& RequiredParameters,
+                                                const TMap<FString, FString>& ExcludedParameters,
+                                                const bool bStaticStages, const bool bWorldStages,
+                                                FDialogueQueryPlan& OutPlan) const
+{
+	OutPlan.Stages.Reset();
+	OutPlan.InitialLines = LiveLines.CountSetBits();
+
+	// Every mask costs at least a pass over its words
+	const int32 NumWords = LiveLines.NumWords();
+
+	if (bWorldStages && Partitions.NumPartitionedLines() > 0)
+	{
+		FDialogueQueryPlanStage& Stage = OutPlan.Stages.AddDefaulted_GetRef();
+		Stage.Stage = EDialogueQueryStage::Partitions;
+		Stage.EstimatedLines = Partitions.CountMatches(WorldStore);
+		Stage.MaskCost = NumWords + Stage.EstimatedLines;
+		Stage.ProbeCostPerLine = 2;
+	}
+
+	if (bStaticStages && (RequiredParameters.Num() > 0 || ExcludedParameters.Num() > 0))
+	{
+		FDialogueQueryPlanStage& Stage = OutPlan.Stages.AddDefaulted_GetRef();
+		Stage.Stage = EDialogueQueryStage::Parameters;
+
+		int32 ListCost;
+		Stage.EstimatedLines = ParameterIndex.Estimate(RequiredParameters, ExcludedParameters, OutPlan.InitialLines, ListCost);
+		Stage.MaskCost = NumWords + ListCost;
+		Stage.ProbeCostPerLine = 2 * (RequiredParameters.Num() + ExcludedParameters.Num());
+	}
+
+	if (bStaticStages && QueryCategories.Num() > 0)
+	{
+		FDialogueQueryPlanStage& Stage = OutPlan.Stages.AddDefaulted_GetRef();
+		Stage.Stage = EDialogueQueryStage::Categories;
+
+		int32 ListCost;
+		Stage.EstimatedLines = CategoryIndex.Estimate(QueryCategories, CategoryMatch, OutPlan.InitialLines, ListCost);
+		Stage.MaskCost = NumWords + ListCost;
+		Stage.ProbeCostPerLine = QueryCategories.Num();
+	}
+
+	if (bWorldStages)
+	{
+		// The lines whose filters passed when they were last scored, plus the ones that need scoring anyway
+		const FDialogueBitSet& DirtyLines = DependencyGraph.GetDirtyLines();
+		int32 NumFiltered = 0;
+		const TArray<uint64>& PassWords = FilterPassLines.GetWords();
+		const TArray<uint64>& DirtyWords = DirtyLines.GetWords();
+		const TArray<uint64>& LiveWords = LiveLines.GetWords();
+		for (int32 WordIdx = 0; WordIdx < NumWords; WordIdx++)
+			NumFiltered += FMath::CountBits((PassWords[WordIdx] | DirtyWords[WordIdx]) & LiveWords[WordIdx]);
+
+		FDialogueQueryPlanStage& Stage = OutPlan.Stages.AddDefaulted_GetRef();
+		Stage.Stage = EDialogueQueryStage::Filters;
+		Stage.EstimatedLines = NumFiltered;
+		Stage.MaskCost = NumWords;
+		Stage.ProbeCostPerLine = 1;
+	}
+
+	// Most selective first, so that the rest only ever looks at its survivors
+	OutPlan.Stages.StableSort([](const FDialogueQueryPlanStage& A, const FDialogueQueryPlanStage& B)
+	{
+		return A.EstimatedLines < B.EstimatedLines;
+	});
+}
+
+void UDialogueManagerSubsystem::ExecuteQueryPlan(FDialogueQueryPlan& Plan,
+                                                 const TArray<FQueryCategory>& QueryCategories,
+                                                 const EDialogueCategoryMatch CategoryMatch,
+                                                 const TMap<FString, FString>& RequiredParameters,
+                                                 const TMap<FString, FString>& ExcludedParameters,
+                                                 FDialogueBitSet& InOutCandidates,
+                                                 const FDialogueBitSet* UnprunedLines) const
+{
+	FDialogueBitSet& StageMask = QueryScratch.StageMask;
+	int32 NumSurviving = InOutCandidates.CountSetBits();
+
+	for (FDialogueQueryPlanStage& Stage : Plan.Stages)
+	{
+		// Nothing left to narrow down
+		if (NumSurviving == 0)
+		{
+			Stage.SurvivingLines = 0;
+			continue;
+		}
+
+		const bool bWorldStage = Stage.Stage == EDialogueQueryStage::Partitions || Stage.Stage == EDialogueQueryStage::Filters;
+		const int64 ProbeCost = static_cast<int64>(NumSurviving) * Stage.ProbeCostPerLine;
+		Stage.Mode = ProbeCost < Stage.MaskCost ? EDialogueStageMode::Probe : EDialogueStageMode::Mask;
+
+		if (Stage.Mode == EDialogueStageMode::Probe)
+		{
+			const FDialogueBitSet& DirtyLines = DependencyGraph.GetDirtyLines();
+
+			// Category names are looked up once, lines are then probed by their category ids
+			FDialogueCategoryIds CategoryIds;
+			if (Stage.Stage == EDialogueQueryStage::Categories)
+				CategoryIndex.FindIds(QueryCategories, CategoryIds);
+
+			InOutCandidates.ForEachSetBit([&](const int32 LineIdx)
+			{
+				if (bWorldStage && UnprunedLines && UnprunedLines->Test(LineIdx))
+					return;
+
+				bool bKeep = true;
+				switch (Stage.Stage)
+				{
+				case EDialogueQueryStage::Partitions:
+					bKeep = Partitions.IsLineViable(LineIdx, WorldStore);
+					break;
+				case EDialogueQueryStage::Parameters:
+					bKeep = FDialogueParameterIndex::Matches(DenseLines[LineIdx], RequiredParameters, ExcludedParameters);
+					break;
+				case EDialogueQueryStage::Categories:
+					bKeep = CategoryIndex.Matches(LineIdx, CategoryIds, CategoryMatch);
+					break;
+				case EDialogueQueryStage::Filters:
+					bKeep = FilterPassLines.Test(LineIdx) || DirtyLines.Test(LineIdx);
+					break;
+				default:
+					break;
+				}
+
+				if (!bKeep)
+					InOutCandidates.Clear(LineIdx);
+			});
+		}
+		else
+		{
+			switch (Stage.Stage)
+			{
+			case EDialogueQueryStage::Partitions:
+				Partitions.BuildMask(WorldStore, DenseLines.Num(), StageMask);
+				break;
+			case EDialogueQueryStage::Parameters:
+				ParameterIndex.BuildMask(RequiredParameters, ExcludedParameters, DenseLines.Num(), StageMask);
+				break;
+			case EDialogueQueryStage::Categories:
+				CategoryIndex.BuildMask(QueryCategories, CategoryMatch, DenseLines.Num(), StageMask);
+				break;
+			case EDialogueQueryStage::Filters:
+				StageMask.CopyFrom(FilterPassLines);
+				StageMask.Or(DependencyGraph.GetDirtyLines());
+				break;
+			}
+
+			if (bWorldStage && UnprunedLines)
+				StageMask.Or(*UnprunedLines);
+			InOutCandidates.And(StageMask);
+		}
+
+		NumSurviving = InOutCandidates.CountSetBits();
+		Stage.SurvivingLines = NumSurviving;
+	}
+}
+
+void UDialogueManagerSubsystem::ProcessSingleLineCallbacks(UContextualDialogueLine* Line)
+{
+	ProcessLineCallbacks(Line);
+}
+
+// TODO: Probably template the whole shit with type of the variable ( ͡° ͜ʖ ͡°)
+FLineScore UDialogueManagerSubsystem::GetLineScore(const UContextualDialogueLine* Line) const
+{
+	return GetLineScore(Line, WorldStore);
+}
+
+bool UDialogueManagerSubsystem::AreFiltersFulfilled(const UContextualDialogueLine* Line) const
+{
+	return AreFiltersFulfilled(Line, WorldStore);
+}
+
+bool UDialogueManagerSubsystem::IsConditionFulfilled(const FDialogueCondition& Condition) const
+{
+	return IsConditionFulfilled(Condition, WorldStore);
+}
+
+FLineScore UDialogueManagerSubsystem::GetLineScore(const UContextualDialogueLine* Line, const FDialogueWorldStateStore& State)
+{
+	float TotalScore = 0;
+
+	for (const FDialogueCondition& Condition : Line->Conditions)
+	{
+		const bool IsFulfilled = IsConditionFulfilled(Condition, State);
+
+		// If not fulfilled and critical - return the whole score as 0
+		if (!IsFulfilled && Condition.IsCritical)
+			return {0.0f, Line->Conditions.Num()};
+
+		TotalScore += IsFulfilled ? 1 : 0;
+	}
+
+	return {TotalScore / Line->Conditions.Num(), Line->Conditions.Num()};
+}
+
+bool UDialogueManagerSubsystem::AreFiltersFulfilled(const UContextualDialogueLine* Line, const FDialogueWorldStateStore& State)
+{
+	for (const FDialogueCondition& Condition : Line->Filters)
+	{
+		// If at least one of filters is not fulfilled - the line is out
+		if (!IsConditionFulfilled(Condition, State))
+			return false;
+	}
+
+	// If all of the conditions passed, then we're all good
+	return true;
+}
+
+bool UDialogueManagerSubsystem::IsConditionFulfilled(const FDialogueCondition& Condition, const FDialogueWorldStateStore& State)
+{
+	// Everything string-related was resolved when the condition was compiled and its variable when it was added to
+	// the database, so this is just slot reads and a compare. Conditions that never went through the database are
+	// resolved by name
+	if (!Condition.IsValidReference)
+		return false;
+
+	const FDialogueVariableRef Ref = Condition.VariableRef.IsValid() ? Condition.VariableRef : State.FindVariable(Condition.ObjectId, Condition.VariableId);
+
+	// Only check conditions if the objects actually exist
+	if (!Ref.IsValid() || !State.IsObjectLive(Ref.ObjectIdx))
+		return false;
+
+	if (Condition.LiteralType != EDialogueLiteralType::String)
+	{
+		// Integer literals compare exactly against integers, anything involving a float compares as a double
+		const int32* IntValue = State.ReadInt(Ref);
+		if (IntValue && Condition.LiteralType == EDialogueLiteralType::Integer)
+			return Condition.CompareInt(*IntValue);
+		if (IntValue)
+			return Condition.CompareNumber(*IntValue);
+
+		if (const double* FloatValue = State.ReadFloat(Ref))
+			return Condition.CompareNumber(*FloatValue);
+
+		// A string variable holding "true" or "false" still matches the boolean literals
+		int32 BoolValue;
+		if (!State.ReadStrBool(Ref, BoolValue))
+			return false;
+		return Condition.LiteralType == EDialogueLiteralType::Integer ? Condition.CompareInt(BoolValue) : Condition.CompareNumber(BoolValue);
+	}
+
+	if (Condition.ConditionType != EQUAL)
+		return false;
+
+	// Both sides are ids of the store, so this is an id compare. Missing string variables behave like empty strings
+	if (Condition.LiteralStrId != INDEX_NONE)
+		return State.ReadStrId(Ref) == Condition.LiteralStrId;
+
+	const FString* VarValue = State.ReadStr(Ref);
+	return VarValue ? *VarValue == Condition.ValueToCompare : Condition.ValueToCompare.IsEmpty();
+}
+
+void UDialogueManagerSubsystem::AddDialogueComponentToWorldState(UDialogueContextComponent* ContextComponent)
+{
+	if (!IsValid(ContextComponent) || WorldStore.FindObject(ContextComponent->DSS_Name) != INDEX_NONE)
+		return;
+
+	const int32 ObjectIdx = WorldStore.FindOrAddObject(ContextComponent->DSS_Name);
+	FDialogueWorldStateStore::FStoreObject& ContextObject = WorldStore.GetObject(ObjectIdx);
+	ContextObject.CallbackNames = ContextComponent->GetCallbackNames();
+	ContextObject.IsMappedToActor = true;
+	ContextObject.ContextRef = ContextComponent;
+
+	SyncObjectMapping(ObjectIdx, ContextComponent);
+	DependencyGraph.MarkObjectDirty(ContextComponent->DSS_Name);
+}
+
+void UDialogueManagerSubsystem::PopulateWorldState()
+{
+	// Add all the object components
 	for (UDialogueContextComponent* ContextComponent : DSS_Components)
 	{
-		FObjectValueMapping ContextMapping;
-		ContextMapping.Name = ContextComponent->DSS_Name;
-		ContextMapping.IntVals = ContextComponent->GetIntVars();
-		ContextMapping.StrVals = ContextComponent->GetStrVars();
-		ContextMapping.CallbackNames = ContextComponent->GetCallbackNames();
-		ContextMapping.IsMappedToActor = true;
-		ContextMapping.ContextRef = ContextComponent;
+		AddDialogueComponentToWorldState(ContextComponent);
+	}
 
-		WorldState.Add(ContextComponent->DSS_Name, ContextMapping);
+	if (WorldStore.FindObject("World") != INDEX_NONE)
+		return;
+
+	// Add global world state
+	const int32 WorldObjectIdx = WorldStore.FindOrAddObject("World");
+	FDialogueWorldStateStore::FStoreObject& WorldObject = WorldStore.GetObject(WorldObjectIdx);
+	// No callbacks for world state.
+	WorldObject.IsMappedToActor = true;
+	WorldObject.ContextRef = this;
+
+	for (const TPair<FString, int>& IntVal : GetIntStateVariables())
+		WorldStore.SetInt(WorldObjectIdx, IntVal.Key, IntVal.Value);
+	for (const TPair<FString, FString>& StrVal : GetStrStateVariables())
+		WorldStore.SetStr(WorldObjectIdx, StrVal.Key, StrVal.Value);
+
+	DependencyGraph.MarkObjectDirty("World");
+	BroadcastWorldState();
+}
+
+void UDialogueManagerSubsystem::UpdateWorldState()
+{
+	// Legacy mode for projects that change DSS_ variables behind the system's back
+	if (GetDefault<UContextualDialogueSettings>()->bPollWorldStateOnQuery)
+	{
+		for (UDialogueContextComponent* ContextComponent : DSS_Components)
+			PushComponentState(ContextComponent);
 	}
 
+	BroadcastWorldStateChange();
+}
+
+void UDialogueManagerSubsystem::BroadcastWorldStateChange()
+{
+	if (!bWorldStateChanged)
+		return;
+	bWorldStateChanged = false;
+
+	BroadcastWorldState();
+}
+
+void UDialogueManagerSubsystem::BroadcastWorldState()
+{
+	// The array handed to the listeners is the only thing left to allocate, skip it when there are none
+	if (!OnWorldStateUpdated.IsBound())
+		return;
+
+	RefreshWorldStateView();
+
 	TArray<FObjectValueMapping> OutValues;
 	WorldState.GenerateValueArray(OutValues);
 	OnWorldStateUpdated.Broadcast(OutValues);
 }
 
-void UDialogueManagerSubsystem::SubscribeNewDSSComponent(UDialogueContextComponent* ContextComponent)
+TSharedRef<const FDialogueWorldStateStore, ESPMode::ThreadSafe> UDialogueManagerSubsystem::GetWorldStoreSnapshot()
 {
-	DSS_Components.Add(ContextComponent);
+	// Running queries keep their own reference, so an outdated snapshot is only freed once they are done with it
+	if (!WorldStoreSnapshot.IsValid() || WorldStoreSnapshot->GetVersion() != WorldStore.GetVersion())
+		WorldStoreSnapshot = MakeShared<const FDialogueWorldStateStore, ESPMode::ThreadSafe>(WorldStore);
 
-	// TODO: Obviously stupid to call the whole function
-	PopulateWorldState();
+	return WorldStoreSnapshot.ToSharedRef();
+}
+
+void UDialogueManagerSubsystem::RefreshWorldStateView()
+{
+	if (WorldStateViewVersion == WorldStore.GetVersion())
+		return;
+
+	for (int32 ObjectIdx = 0; ObjectIdx < WorldStore.NumObjects(); ObjectIdx++)
+	{
+		// Objects only reserved by the conditions reading them aren't part of the World State
+		const FDialogueWorldStateStore::FStoreObject& Object = WorldStore.GetObject(ObjectIdx);
+		if (Object.IsLive && Object.Version > WorldStateViewVersion)
+			WorldStore.ExportObject(ObjectIdx, WorldState.FindOrAdd(Object.Name));
+	}
+
+	WorldStateViewVersion = WorldStore.GetVersion();
+}
+
+void UDialogueManagerSubsystem::PushComponentState(UDialogueContextComponent* ContextComponent)
+{
+	const int32 ObjectIdx = WorldStore.FindObject(ContextComponent->DSS_Name);
+	if (ObjectIdx == INDEX_NONE)
+	{
+		AddDialogueComponentToWorldState(ContextComponent);
+		bWorldStateChanged = true;
+		return;
+	}
+
+	// Known objects are updated in place, only the variables that actually changed are written
+	SyncObjectMapping(ObjectIdx, ContextComponent);
+
+	FDialogueWorldStateStore::FStoreObject& ContextObject = WorldStore.GetObject(ObjectIdx);
+	const TArray<FString>& CallbackNames = ContextComponent->GetCallbackNames();
+	if (ContextObject.CallbackNames != CallbackNames || !ContextObject.IsMappedToActor || ContextObject.ContextRef != ContextComponent)
+	{
+		ContextObject.CallbackNames = CallbackNames;
+		ContextObject.IsMappedToActor = true;
+		ContextObject.ContextRef = ContextComponent;
+		WorldStore.TouchObject(ObjectIdx);
+		bWorldStateChanged = true;
+	}
+}
+
+void UDialogueManagerSubsystem::PushIntValue(const FString& ObjectName, const FString& VarName, const int NewVal)
+{
+	const int32 ObjectIdx = WorldStore.FindObject(ObjectName);
+	if (ObjectIdx != INDEX_NONE)
+		WriteIntVariable(ObjectIdx, VarName, NewVal);
+}
+
+void UDialogueManagerSubsystem::PushStrValue(const FString& ObjectName, const FString& VarName, const FString& NewVal)
+{
+	const int32 ObjectIdx = WorldStore.FindObject(ObjectName);
+	if (ObjectIdx != INDEX_NONE)
+		WriteStrVariable(ObjectIdx, VarName, NewVal);
+}
+
+void UDialogueManagerSubsystem::PushFloatValue(const FString& ObjectName, const FString& VarName, const double NewVal)
+{
+	const int32 ObjectIdx = WorldStore.FindObject(ObjectName);
+	if (ObjectIdx != INDEX_NONE)
+		WriteFloatVariable(ObjectIdx, VarName, NewVal);
+}
+
+void UDialogueManagerSubsystem::PushNameValue(const FString& ObjectName, const FString& VarName, const FName NewVal)
+{
+	const int32 ObjectIdx = WorldStore.FindObject(ObjectName);
+	if (ObjectIdx != INDEX_NONE)
+		WriteNameVariable(ObjectIdx, VarName, NewVal);
+}
+
+void UDialogueManagerSubsystem::WriteIntVariable(const int32 ObjectIdx, const FString& VarName, const int NewVal)
+{
+	if (!WorldStore.SetInt(ObjectIdx, VarName, NewVal))
+		return;
+
+	DependencyGraph.MarkVariableDirty(WorldStore.GetObject(ObjectIdx).Name, VarName);
+	bWorldStateChanged = true;
+}
+
+void UDialogueManagerSubsystem::WriteFloatVariable(const int32 ObjectIdx, const FString& VarName, const double NewVal)
+{
+	if (!WorldStore.SetFloat(ObjectIdx, VarName, NewVal))
+		return;
+
+	DependencyGraph.MarkVariableDirty(WorldStore.GetObject(ObjectIdx).Name, VarName);
+	bWorldStateChanged = true;
+}
+
+void UDialogueManagerSubsystem::WriteStrVariable(const int32 ObjectIdx, const FString& VarName, const FString& NewVal)
+{
+	if (!WorldStore.SetStr(ObjectIdx, VarName, NewVal))
+		return;
+
+	DependencyGraph.MarkVariableDirty(WorldStore.GetObject(ObjectIdx).Name, VarName);
+	bWorldStateChanged = true;
+}
+
+void UDialogueManagerSubsystem::WriteNameVariable(const int32 ObjectIdx, const FString& VarName, const FName NewVal)
+{
+	if (!WorldStore.SetName(ObjectIdx, VarName, NewVal))
+		return;
+
+	DependencyGraph.MarkVariableDirty(WorldStore.GetObject(ObjectIdx).Name, VarName);
+	bWorldStateChanged = true;
+}
+
+UDialogueContextComponent* UDialogueManagerSubsystem::GetMappedComponent(const int32 ObjectIdx) const
+{
+	const FDialogueWorldStateStore::FStoreObject& Object = WorldStore.GetObject(ObjectIdx);
+	return Object.IsMappedToActor ? Cast<UDialogueContextComponent>(Object.ContextRef) : nullptr;
+}
+
+void UDialogueManagerSubsystem::WriteMappedIntVariable(const int32 ObjectIdx, const FString& VarName, const int NewVal)
+{
+	if (UDialogueContextComponent* ContextComponent = GetMappedComponent(ObjectIdx))
+	{
+		ContextComponent->UpdateIntValue(VarName, NewVal);
+		if (ContextComponent->IsDialogueVarConstrained(VarName))
+		{
+			ContextComponent->MarkDialogueVarDirty(VarName);
+			return;
+		}
+	}
+
+	WriteIntVariable(ObjectIdx, VarName, NewVal);
+}
+
+void UDialogueManagerSubsystem::WriteMappedFloatVariable(const int32 ObjectIdx, const FString& VarName, const double NewVal)
+{
+	if (UDialogueContextComponent* ContextComponent = GetMappedComponent(ObjectIdx))
+	{
+		ContextComponent->UpdateFloatValue(VarName, NewVal);
+		if (ContextComponent->IsDialogueVarConstrained(VarName))
+		{
+			ContextComponent->MarkDialogueVarDirty(VarName);
+			return;
+		}
+	}
+
+	WriteFloatVariable(ObjectIdx, VarName, NewVal);
+}
+
+void UDialogueManagerSubsystem::WriteMappedStrVariable(const int32 ObjectIdx, const FString& VarName, const FString& NewVal)
+{
+	if (UDialogueContextComponent* ContextComponent = GetMappedComponent(ObjectIdx))
+	{
+		ContextComponent->UpdateStrValue(VarName, NewVal);
+		if (ContextComponent->IsDialogueVarConstrained(VarName))
+		{
+			ContextComponent->MarkDialogueVarDirty(VarName);
+			return;
+		}
+	}
+
+	WriteStrVariable(ObjectIdx, VarName, NewVal);
+}
+
+void UDialogueManagerSubsystem::SyncObjectMapping(const int32 ObjectIdx, UDialogueContextComponent* ContextComponent)
+{
+	const FDialogueClassDescriptor& Descriptor = ContextComponent->GetClassDescriptor();
+	const AActor* Actor = ContextComponent->GetOwner();
+
+	// The store compares before it writes, so unchanged values are neither copied nor marked dirty
+	for (const TPair<FString, const FIntProperty*>& Property : Descriptor.IntProperties)
+		WriteIntVariable(ObjectIdx, Property.Key, Property.Value->GetPropertyValue_InContainer(Actor));
+
+	for (const TPair<FString, const FStrProperty*>& Property : Descriptor.StrProperties)
+		WriteStrVariable(ObjectIdx, Property.Key, *Property.Value->GetPropertyValuePtr_InContainer(Actor));
+
+	for (const TPair<FString, const FBoolProperty*>& Property : Descriptor.BoolProperties)
+		WriteIntVariable(ObjectIdx, Property.Key, Property.Value->GetPropertyValue_InContainer(Actor) ? 1 : 0);
+
+	for (const TPair<FString, const FNumericProperty*>& Property : Descriptor.FloatProperties)
+		WriteFloatVariable(ObjectIdx, Property.Key, Property.Value->GetFloatingPointPropertyValue(Property.Value->ContainerPtrToValuePtr<void>(Actor)));
+
+	for (const TPair<FString, const FProperty*>& Property : Descriptor.NameProperties)
+		WriteNameVariable(ObjectIdx, Property.Key, FDialogueClassDescriptor::ReadName(Property.Value, Actor));
+
+	// Variables the actor doesn't have (e.g. loaded from an older save) changed as well. Removing a variable keeps its
+	// slot, so the slot maps can be walked while doing so
+	const FDialogueWorldStateStore::FStoreObject& ContextObject = WorldStore.GetObject(ObjectIdx);
+	for (const TPair<FString, int32>& Slot : ContextObject.IntSlots)
+	{
+		const bool bOnActor = Descriptor.IntProperties.Contains(Slot.Key) || Descriptor.BoolProperties.Contains(Slot.Key);
+		if (!bOnActor && WorldStore.RemoveInt(ObjectIdx, Slot.Key))
+		{
+			DependencyGraph.MarkVariableDirty(ContextObject.Name, Slot.Key);
+			bWorldStateChanged = true;
+		}
+	}
+
+	for (const TPair<FString, int32>& Slot : ContextObject.FloatSlots)
+	{
+		if (!Descriptor.FloatProperties.Contains(Slot.Key) && WorldStore.RemoveFloat(ObjectIdx, Slot.Key))
+		{
+			DependencyGraph.MarkVariableDirty(ContextObject.Name, Slot.Key);
+			bWorldStateChanged = true;
+		}
+	}
+
+	for (const TPair<FString, int32>& Slot : ContextObject.StrSlots)
+	{
+		const bool bOnActor = Descriptor.StrProperties.Contains(Slot.Key) || Descriptor.NameProperties.Contains(Slot.Key);
+		if (!bOnActor && WorldStore.RemoveStr(ObjectIdx, Slot.Key))
+		{
+			DependencyGraph.MarkVariableDirty(ContextObject.Name, Slot.Key);
+			bWorldStateChanged = true;
+		}
+	}
+}
+
+void UDialogueManagerSubsystem::SubscribeNewDSSComponent(UDialogueContextComponent* ContextComponent)
+{
+	RegisterComponents(MakeArrayView(&ContextComponent, 1));
 }
 
 void UDialogueManagerSubsystem::UnsubscribeDSSComponent(UDialogueContextComponent* ContextComponent)
 {
-	DSS_Components.Remove(ContextComponent);
+	UnregisterComponents(MakeArrayView(&ContextComponent, 1));
+}
 
-	// TODO: Obviously stupid to call the whole function
-	PopulateWorldState();
+void UDialogueManagerSubsystem::RegisterComponents(TArrayView<UDialogueContextComponent* const> ContextComponents)
+{
+	for (UDialogueContextComponent* ContextComponent : ContextComponents)
+	{
+		if (!IsValid(ContextComponent) || !DSS_Components.Add(ContextComponent))
+			continue;
+
+		// An object that was streamed out keeps its slots, it is mapped to the new actor and re-reads it. The actor is
+		// the source of truth for its DSS_ variables, exactly as when it was first registered - putting saved values
+		// back into actors is the job of the save game, not of streaming
+		const int32 ObjectIdx = WorldStore.FindObject(ContextComponent->DSS_Name);
+		if (ObjectIdx != INDEX_NONE)
+		{
+			FDialogueWorldStateStore::FStoreObject& ContextObject = WorldStore.GetObject(ObjectIdx);
+			ContextObject.CallbackNames = ContextComponent->GetCallbackNames();
+			ContextObject.IsMappedToActor = true;
+			ContextObject.ContextRef = ContextComponent;
+			WorldStore.TouchObject(ObjectIdx);
+			SyncObjectMapping(ObjectIdx, ContextComponent);
+		}
+		else
+		{
+			AddDialogueComponentToWorldState(ContextComponent);
+		}
+		bWorldStateChanged = true;
+	}
+
+	BroadcastWorldStateChange();
+}
+
+void UDialogueManagerSubsystem::UnregisterComponents(TArrayView<UDialogueContextComponent* const> ContextComponents)
+{
+	for (UDialogueContextComponent* ContextComponent : ContextComponents)
+	{
+		if (!ContextComponent || !DSS_Components.Remove(ContextComponent))
+			continue;
+
+		// Keep the values around, but never call into a component that is going away
+		const int32 ObjectIdx = WorldStore.FindObject(ContextComponent->DSS_Name);
+		if (ObjectIdx == INDEX_NONE)
+			continue;
+
+		FDialogueWorldStateStore::FStoreObject& ContextObject = WorldStore.GetObject(ObjectIdx);
+		if (ContextObject.ContextRef == ContextComponent)
+		{
+			ContextObject.IsMappedToActor = false;
+			ContextObject.ContextRef = nullptr;
+			WorldStore.TouchObject(ObjectIdx);
+			bWorldStateChanged = true;
+		}
+	}
+
+	BroadcastWorldStateChange();
 }
 
 void UDialogueManagerSubsystem::DebugPrintJsonObject(TSharedPtr<FJsonObject> JsonObject)
@@ -824,21 +1860,29 @@ TSharedPtr<FJsonObject> UDialogueManagerSubsystem::GetContextVariablesAsJSON()
 {
 	TSharedPtr<FJsonObject> ReturnJSON(new FJsonObject());
 	
-	for (const TPair<FString, FObjectValueMapping>& Mapping : WorldState)
+	for (int32 ObjectIdx = 0; ObjectIdx < WorldStore.NumObjects(); ObjectIdx++)
 	{
+		if (!WorldStore.IsObjectLive(ObjectIdx))
+			continue;
+
 		TSharedPtr<FJsonObject> MappingJSON(new FJsonObject());
 
-		for (const TPair<FString, FString>& StrVar : Mapping.Value.StrVals)
+		WorldStore.ForEachStr(ObjectIdx, [&MappingJSON](const FString& VarName, const FString& Value)
 		{
-			MappingJSON->SetStringField(StrVar.Key, StrVar.Value);
-		}
+			MappingJSON->SetStringField(VarName, Value);
+		});
 
-		for (const TPair<FString, int>& IntVal : Mapping.Value.IntVals)
+		WorldStore.ForEachInt(ObjectIdx, [&MappingJSON](const FString& VarName, const int32 Value)
 		{
-			MappingJSON->SetNumberField(IntVal.Key, IntVal.Value);
-		}
+			MappingJSON->SetNumberField(VarName, Value);
+		});
+
+		WorldStore.ForEachFloat(ObjectIdx, [&MappingJSON](const FString& VarName, const double Value)
+		{
+			MappingJSON->SetNumberField(VarName, Value);
+		});
 
-		ReturnJSON->SetObjectField(Mapping.Key, MappingJSON);
+		ReturnJSON->SetObjectField(WorldStore.GetObject(ObjectIdx).Name, MappingJSON);
 	}
 
 	return ReturnJSON;
@@ -855,43 +1899,49 @@ FString UDialogueManagerSubsystem::GetDialogueLineParameterByName(UContextualDia
 
 void UDialogueManagerSubsystem::SetCurrentSpeaker(const FString NewSpeaker)
 {
-	WorldState["World"].StrVals.Add("Speaker", NewSpeaker);
-
-	TArray<FObjectValueMapping> OutValues;
-	WorldState.GenerateValueArray(OutValues);
-	OnWorldStateUpdated.Broadcast(OutValues);
+	WriteStrVariable(WorldStore.FindOrAddObject("World"), "Speaker", NewSpeaker);
+	BroadcastWorldStateChange();
 }
 
 void UDialogueManagerSubsystem::SetWorldVariable(const FString VarName, const FString NewValue)
 {
+	const int32 WorldObjectIdx = WorldStore.FindOrAddObject("World");
 	if (IsStringANumber(NewValue))
 	{
-		WorldState["World"].IntVals.Add(VarName, FCString::Atoi(*NewValue));
+		// Whole numbers are integers, the rest are floats rather than being truncated
+		const double NumberValue = FCString::Atod(*NewValue);
+		if (FMath::Frac(NumberValue) != 0.0)
+			WriteFloatVariable(WorldObjectIdx, VarName, NumberValue);
+		else
+			WriteIntVariable(WorldObjectIdx, VarName, FCString::Atoi(*NewValue));
 	}
 	else
 	{
-		WorldState["World"].StrVals.Add(VarName, NewValue);
+		WriteStrVariable(WorldObjectIdx, VarName, NewValue);
 	}
-	TArray<FObjectValueMapping> OutValues;
-	WorldState.GenerateValueArray(OutValues);
-	OnWorldStateUpdated.Broadcast(OutValues);
+	BroadcastWorldStateChange();
 }
 
 FString UDialogueManagerSubsystem::GetVariable(const FString& VarName, const FString& Scope)
 {
 	// If the scope doesn't exist, just return an empty string
-	if (!WorldState.Contains(Scope))
+	const int32 ObjectIdx = WorldStore.FindObject(Scope);
+	if (ObjectIdx == INDEX_NONE)
 		return "";
 
 	// TODO: Just... Don't look at it (falls under the "refactor to unify variables types" category)
-	FString* OutVarStr = WorldState[Scope].StrVals.Find(VarName);
+	const FString* OutVarStr = WorldStore.FindStr(ObjectIdx, VarName);
 	if (OutVarStr)
 		return *OutVarStr;
 
-	int* OutVarInt = WorldState[Scope].IntVals.Find(VarName);
+	const int32* OutVarInt = WorldStore.FindInt(ObjectIdx, VarName);
 	if (OutVarInt)
 		return FString::FromInt(*OutVarInt);
 
+	const double* OutVarFloat = WorldStore.FindFloat(ObjectIdx, VarName);
+	if (OutVarFloat)
+		return FString::SanitizeFloat(*OutVarFloat);
+
 	return "";
 }
 
@@ -969,19 +2019,15 @@ void UDialogueManagerSubsystem::ProcessLineCallbacks(UContextualDialogueLine* Li
 	{
 		TArray<FString> Keys;
 		Callback.ObjectReference.ParseIntoArray(Keys, TEXT("."));
-		FObjectValueMapping* ParentObject = WorldState.Find(Keys[0]);
+		int32 ParentIdx = WorldStore.FindObject(Keys[0]);
 
-		if (!ParentObject)
+		if (ParentIdx == INDEX_NONE)
 		{
-			// If the object doesn't exist BUT its name is a dialogue line ID then add it to the world state
+			// If the object doesn't exist BUT its name is a dialogue line ID then add it to the world state, not mapped to
+			// any actor
 			if (DialogueLookup.Contains(Keys[0]) || Keys[0] == "this")
 			{
-				FObjectValueMapping ContextMapping;
-				ContextMapping.Name = Keys[0] == "this" ? Line->UniqueName : Keys[0]; // Variable owner
-				ContextMapping.IsMappedToActor = false;
-				ContextMapping.ContextRef = nullptr;
-
-				ParentObject = &WorldState.Add(ContextMapping.Name, ContextMapping);
+				ParentIdx = WorldStore.FindOrAddObject(Keys[0] == "this" ? Line->UniqueName : Keys[0]); // Variable owner
 			}
 			else
 			{
@@ -1002,6 +2048,8 @@ void UDialogueManagerSubsystem::ProcessLineCallbacks(UContextualDialogueLine* Li
 			}
 		}
 
+		const FDialogueWorldStateStore::FStoreObject* ParentObject = &WorldStore.GetObject(ParentIdx);
+
 		if (Callback.CallbackType == EXECUTE)
 		{
 			if (Keys.Num() < 1)
@@ -1053,16 +2101,29 @@ void UDialogueManagerSubsystem::ProcessLineCallbacks(UContextualDialogueLine* Li
 				}
 				ParsedParameters.Add(ParamName, ParamValue);
 			}
-			Cast<UDialogueContextComponent>(ParentObject->ContextRef)->ExecuteCallback(Keys[1], ParsedParameters);
+			// Objects whose actor has been streamed out keep their variables, but have nobody to call back
+			if (UDialogueContextComponent* ContextComponent = Cast<UDialogueContextComponent>(ParentObject->ContextRef))
+				ContextComponent->ExecuteCallback(Keys[1], ParsedParameters);
 		}
 		else
 		{
 			// TODO: Just like before, this is not the best and should be refactored into a templated container or something similar
-			if (IsStringANumber(Callback.Parameter))
+			const bool bIsBool = Callback.Parameter.Equals(TEXT("true"), ESearchCase::IgnoreCase) ||
+				Callback.Parameter.Equals(TEXT("false"), ESearchCase::IgnoreCase);
+			const bool bIsNumber = IsStringANumber(Callback.Parameter);
+
+			// Variables keep the lane their value is in: string variables stay strings, even when assigned "true" or a
+			// number, float variables stay floats, and a fraction is never cut off - unless the variable is an integer
+			// already. Slots reserved by the conditions don't count, only the values that have actually been written
+			const bool bIsStr = WorldStore.FindStr(ParentIdx, Keys[1]) != nullptr;
+			const bool bIsFloat = !bIsStr && bIsNumber && (WorldStore.FindFloat(ParentIdx, Keys[1]) != nullptr ||
+				(WorldStore.FindInt(ParentIdx, Keys[1]) == nullptr && FMath::Frac(FCString::Atod(*Callback.Parameter)) != 0.0));
+
+			if (bIsFloat)
 			{
-				int NewVal;
-				FDefaultValueHelper::ParseInt(Callback.Parameter, NewVal);
-				const int OldVal = ParentObject->IntVals.Contains(Keys[1]) ? ParentObject->IntVals[Keys[1]] : 0;
+				double NewVal = FCString::Atod(*Callback.Parameter);
+				const double* OldValPtr = WorldStore.FindFloat(ParentIdx, Keys[1]);
+				const double OldVal = OldValPtr ? *OldValPtr : 0.0;
 
 				switch (Callback.CallbackType)
 				{
@@ -1078,25 +2139,39 @@ void UDialogueManagerSubsystem::ProcessLineCallbacks(UContextualDialogueLine* Li
 					return;
 				}
 
-				ParentObject->IntVals.Emplace(Keys[1], NewVal);
+				WriteMappedFloatVariable(ParentIdx, Keys[1], NewVal);
+			}
+			else if (!bIsStr && (bIsNumber || bIsBool))
+			{
+				// Booleans are integers as far as the World State is concerned
+				int NewVal = Callback.Parameter.Equals(TEXT("true"), ESearchCase::IgnoreCase) ? 1 : 0;
+				if (bIsNumber)
+					FDefaultValueHelper::ParseInt(Callback.Parameter, NewVal);
+				const int32* OldValPtr = WorldStore.FindInt(ParentIdx, Keys[1]);
+				const int OldVal = OldValPtr ? *OldValPtr : 0;
 
-				if (ParentObject->IsMappedToActor)
+				switch (Callback.CallbackType)
 				{
-					// If the property is mapped to actor - update it in the actual actor
-					if (ParentObject->ContextRef == this)
-					{
-						this->UpdateIntValue(Keys[1], NewVal);
-					}
-					else
-					{
-						static_cast<UDialogueContextComponent*>(ParentObject->ContextRef)->UpdateIntValue(Keys[1], NewVal);
-					}
+				case ASSIGN:
+					break;
+				case ADD:
+					NewVal += OldVal;
+					break;
+				case SUBTRACT:
+					NewVal = OldVal - NewVal;
+					break;
+				default:
+					return;
 				}
+
+				// If the property is mapped to actor - update it in the actual actor
+				WriteMappedIntVariable(ParentIdx, Keys[1], NewVal);
 			}
 			else
 			{
 				FString NewVal = Callback.Parameter;
-				const FString OldVal = ParentObject->StrVals.Contains(Keys[1]) ? ParentObject->StrVals[Keys[1]] : "";
+				const FString* OldValPtr = WorldStore.FindStr(ParentIdx, Keys[1]);
+				const FString OldVal = OldValPtr ? *OldValPtr : "";
 
 				switch (Callback.CallbackType)
 				{
@@ -1110,19 +2185,7 @@ void UDialogueManagerSubsystem::ProcessLineCallbacks(UContextualDialogueLine* Li
 				default:
 					return;
 				}
-				ParentObject->StrVals.Emplace(Keys[1], NewVal);
-
-				if (ParentObject->IsMappedToActor)
-				{
-					if (ParentObject->ContextRef == this)
-					{
-						this->UpdateStrValue(Keys[1], NewVal);
-					}
-					else
-					{
-						static_cast<UDialogueContextComponent*>(ParentObject->ContextRef)->UpdateStrValue(Keys[1], NewVal);
-					}
-				}
+				WriteMappedStrVariable(ParentIdx, Keys[1], NewVal);
 			}
 		}
 	}
@@ -1139,10 +2202,7 @@ void UDialogueManagerSubsystem::CheckAndLoadGame()
 		TSharedPtr<FJsonObject> WorldContextJSON;
 		LoadWorldContextFromLatestSaveJsonFile(WorldContextJSON);
 		UpdateWorldStateFromJSON(WorldContextJSON);
-
-		TArray<FObjectValueMapping> OutValues;
-		WorldState.GenerateValueArray(OutValues);
-		OnWorldStateUpdated.Broadcast(OutValues);
+		BroadcastWorldState();
 		
 		OnDialogueAndWorldStateLoaded.Broadcast();
 	}
@@ -1,6 +1,5 @@
 #include "DialogueManagerUtils.h"
 
-#include "FArrayUtils.h"
 #include "Serialization/JsonTypes.h"
 #include "Serialization/JsonSerializer.h"
 
@@ -21,6 +20,61 @@ FString FDialogueCondition::ConditionValueAsString() const
 	return EConditionType_sign[ConditionType] + ValueToCompare;
 }
 
+/**
+ *	Mirrors the old runtime number check - a literal is numeric when it only consists of digits, dots and signs.
+ *	Kept deliberately lenient so that already authored databases resolve to the same types as before.
+ */
+static bool IsLiteralNumeric(const FString& Literal)
+{
+	for (const TCHAR Char : Literal)
+	{
+		if (!FChar::IsDigit(Char) && Char != TEXT('.') && Char != TEXT('-') && Char != TEXT('+'))
+			return false;
+	}
+	return true;
+}
+
+bool FDialogueCondition::Compile()
+{
+	ObjectId.Reset();
+	VariableId.Reset();
+	IsValidReference = VariableToCheck.Split(TEXT("."), &ObjectId, &VariableId) && !ObjectId.IsEmpty() && !VariableId.IsEmpty();
+
+	if (!IsValidReference)
+	{
+		UE_LOG(DialogueManagerUtils, Warning,
+		       TEXT("[DIALOGUE] Condition references '%s', expected an 'Object.Variable' pair. It will never be fulfilled"), *VariableToCheck)
+	}
+
+	VariableRef = FDialogueVariableRef();
+	LiteralStrId = INDEX_NONE;
+	IntValue = 0;
+	NumberValue = 0.0;
+
+	// Booleans live in the integer lane of the World State as 0 and 1. String variables holding "true" or "false" are
+	// read as such too, see FDialogueWorldStateStore::ReadStrBool()
+	if (ValueToCompare.Equals(TEXT("true"), ESearchCase::IgnoreCase) || ValueToCompare.Equals(TEXT("false"), ESearchCase::IgnoreCase))
+	{
+		LiteralType = EDialogueLiteralType::Integer;
+		IntValue = ValueToCompare.Equals(TEXT("true"), ESearchCase::IgnoreCase) ? 1 : 0;
+		NumberValue = IntValue;
+	}
+	else if (IsLiteralNumeric(ValueToCompare))
+	{
+		// Only whole numbers go the integer way, "0.5" used to be truncated into 0
+		NumberValue = FCString::Atod(*ValueToCompare);
+		const bool bIsWhole = FMath::Frac(NumberValue) == 0.0 && NumberValue >= MIN_int32 && NumberValue <= MAX_int32;
+		LiteralType = bIsWhole ? EDialogueLiteralType::Integer : EDialogueLiteralType::Float;
+		IntValue = bIsWhole ? static_cast<int32>(NumberValue) : 0;
+	}
+	else
+	{
+		LiteralType = EDialogueLiteralType::String;
+	}
+
+	return IsValidReference;
+}
+
 FString FDialogueCondition::ToString() const
 {
 	return FString::Printf(TEXT("{ Var: %s, Type: %hs, CompareTo: %s }"), *VariableToCheck, EConditionType_str[ConditionType], *ValueToCompare);
@@ -134,6 +188,14 @@ TSharedPtr<FJsonObject> UContextualDialogueLine::ToJsonObject()
 		FiltersJSON->SetStringField(Condition.VariableToCheck, Condition.ConditionValueAsString());
 	}
 	LineJSON->SetObjectField("Filters", FiltersJSON);
+
+	if (!CategoryTags.IsEmpty())
+	{
+		TArray<TSharedPtr<FJsonValue>> TagsJSON;
+		for (const FGameplayTag& Tag : CategoryTags)
+			TagsJSON.Add(MakeShared<FJsonValueString>(Tag.ToString()));
+		LineJSON->SetArrayField("CategoryTags", TagsJSON);
+	}
 	
 	return LineJSON;
 }
@@ -222,97 +284,25 @@ bool UContextualDialogueLine::PopulateFromJsonObject(FString NewUniqueName, cons
 		this->Parameters = Params;
 	}
 
-	return true;
-}
-
-bool FMultipleLineScoring::CheckAndAddLine(UContextualDialogueLine* Line, FLineScore Score)
-{
-	// First element
-	if(CurrLines == 0)
-	{
-		Lines.Add(Line);
-		Scores.Add(Score);
-
-		CurrMinScore = CurrMaxScore = &Scores.Last();
-		CurrMinIdx = CurrMaxIdx = 0;
-
-		CurrLines++;
-		
-		return true;
-	}
-	
-	// If we're not at capacity, just add the line
-	if(CurrLines < NoLines)
-	{
-		Lines.Add(Line);
-		const int NewIdx = Scores.Add(Score);
-
-		if(Score < *CurrMinScore)
-		{
-			CurrMinScore = &Scores.Last();
-			CurrMinIdx = NewIdx;
-		}
-		else if (Score > *CurrMaxScore)
-		{
-			CurrMaxScore = &Scores.Last();
-			CurrMaxIdx = NewIdx;
-		}
-		
-		CurrLines++;
-		return true;
-	}
-
-	// If we're better than the lowest score in array - swap new element with it
-	if(Score > *CurrMinScore)
+	const TArray<TSharedPtr<FJsonValue>>* NewCategoryTags;
+	if (LineJsonObject->TryGetArrayField("CategoryTags", NewCategoryTags))
 	{
-		Lines[CurrMinIdx] = Line;
-		Scores[CurrMinIdx] = Score;
-
-		// Additionally, we could've beaten the best score in the array
-		if(Score > *CurrMaxScore)
+		for (const TSharedPtr<FJsonValue>& TagValue : *NewCategoryTags)
 		{
-			CurrMaxIdx = CurrMinIdx;
-		}
-
-		// Look for new minimum
-		CurrMinScore = CurrMaxScore;
-		for (int i = 0; i < Scores.Num(); i++)
-		{
-			if(Scores[i] < *CurrMinScore)
+			// Unknown tags are skipped rather than failing the whole line, the tag table may simply be out of date
+			const FString TagName = TagValue->AsString();
+			const FGameplayTag Tag = FGameplayTag::RequestGameplayTag(FName(*TagName), false);
+			if (!Tag.IsValid())
 			{
-				CurrMinScore = &Scores[i];
-				CurrMinIdx = i;
+				UE_LOG(DialogueManagerUtils, Display, TEXT("[DIALOGUE] Unknown category tag %s in line %s"), *TagName, *UniqueName)
+				continue;
 			}
+
+			CategoryTags.AddTag(Tag);
 		}
 	}
-	
-	return false;
-}
 
-void FMultipleLineScoring::GetNBestResults(const int NoOfElements, TArray<UContextualDialogueLine*>& OutLines)
-{
-	if (Lines.Num() == 0)
-	{
-		return;
-	}
-	
-	// Sort scores and lines
-	FArrayUtils::SortArray(Scores, [this](const int32 Index1, const int32 Index2) {
-		Scores.SwapMemory(Index2, Index1);
-		Lines.SwapMemory(Index2, Index1);
-	});
-
-	// TArray<TPair<FString, FString>> LinesAsStrings;
-	// Algo::Transform(Lines, LinesAsStrings, [](TSharedPtr<FDialogueLine> Line){return Line->LineToSay; });
-	const TArrayView<UContextualDialogueLine*> Tmp = MakeArrayView(Lines).Slice(FMath::Max(Lines.Num() - 1 - NoOfElements, 0),
-																					FMath::Min(NoOfElements, Lines.Num()));
-
-	for(UContextualDialogueLine* Line : Tmp)
-	{
-		// Only add lines with score other than 0
-		if(Scores[Lines.Find(Line)].Score > 0.0f)
-			OutLines.Add(Line);
-	}
+	return true;
 }
 
 bool ParseConditionsIntoArray(const TSharedPtr<FJsonObject>* Conditions, TArray<FDialogueCondition>& OutArray)
@@ -342,24 +332,47 @@ bool ParseConditionsIntoArray(const TSharedPtr<FJsonObject>* Conditions, TArray<
 			RawCondition = Condition.Value->AsString();
 		}
 				
-		const CHAR& ControlSequence = RawCondition[0];
-		switch(ControlSequence)
+		if (RawCondition.IsEmpty())
 		{
-			// TODO: Could probably index the enum with strings and have an implicit constructor from the char...?
+			UE_LOG(DialogueManagerUtils, Display, TEXT("[DIALOGUE] Empty condition for variable: %s"), *NewCondition.VariableToCheck)
+			return false;
+		}
+
+		// Two-character operators have to be checked first, ConditionValueAsString() writes them back that way
+		int32 OperatorLength = 1;
+		if (RawCondition.StartsWith(TEXT("<=")))
+		{
+			NewCondition.ConditionType = LET;
+			OperatorLength = 2;
+		}
+		else if (RawCondition.StartsWith(TEXT(">=")))
+		{
+			NewCondition.ConditionType = GET;
+			OperatorLength = 2;
+		}
+		else
+		{
+			const TCHAR ControlSequence = RawCondition[0];
+			switch(ControlSequence)
+			{
 			case '=':
 				NewCondition.ConditionType = EQUAL;
-			break;
-		case '>':
-			NewCondition.ConditionType = GT;
-			break;
-		case '<':
-			NewCondition.ConditionType = LT;
-			break;
-		default:
-			UE_LOG(DialogueManagerUtils, Display, TEXT("[DIALOGUE] Unrecongnized condition control sequence: %s"), RawCondition[0])
-			return false;
+				break;
+			case '>':
+				NewCondition.ConditionType = GT;
+				break;
+			case '<':
+				NewCondition.ConditionType = LT;
+				break;
+			default:
+				UE_LOG(DialogueManagerUtils, Display, TEXT("[DIALOGUE] Unrecongnized condition control sequence: %c"), ControlSequence)
+				return false;
+			}
 		}
-		NewCondition.ValueToCompare = RawCondition.RightChop(1);
+		NewCondition.ValueToCompare = RawCondition.RightChop(OperatorLength);
+
+		// Resolve everything the query needs once, instead of on every evaluation
+		NewCondition.Compile();
 		OutArray.Add(NewCondition);
 	}
 
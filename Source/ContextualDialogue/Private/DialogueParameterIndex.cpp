@@ -0,0 +1,171 @@
+#include "DialogueParameterIndex.h"
+
+#include "DialogueManagerUtils.h"
+
+const FString FDialogueParameterIndex::Wildcard = TEXT("*");
+
+void FDialogueParameterIndex::Reset()
+{
+	KeyPostings.Empty();
+	KeyValuePostings.Empty();
+}
+
+void FDialogueParameterIndex::AddLine(const UContextualDialogueLine* Line)
+{
+	check(Line->DenseIndex != INDEX_NONE);
+
+	for (const TPair<FString, FString>& Parameter : Line->Parameters)
+	{
+		FDialoguePostingListUtils::Insert(KeyPostings.FindOrAdd(Parameter.Key), Line->DenseIndex);
+		FDialoguePostingListUtils::Insert(KeyValuePostings.FindOrAdd(Parameter.Key).FindOrAdd(Parameter.Value), Line->DenseIndex);
+	}
+}
+
+void FDialogueParameterIndex::RemoveLine(const UContextualDialogueLine* Line)
+{
+	for (const TPair<FString, FString>& Parameter : Line->Parameters)
+	{
+		if (FDialoguePostingList* KeyList = KeyPostings.Find(Parameter.Key))
+			FDialoguePostingListUtils::Remove(*KeyList, Line->DenseIndex);
+
+		if (TMap<FString, FDialoguePostingList>* Values = KeyValuePostings.Find(Parameter.Key))
+		{
+			if (FDialoguePostingList* ValueList = Values->Find(Parameter.Value))
+				FDialoguePostingListUtils::Remove(*ValueList, Line->DenseIndex);
+		}
+	}
+}
+
+const FDialoguePostingList* FDialogueParameterIndex::Find(const FString& Key, const FString& Value) const
+{
+	if (Value == Wildcard)
+		return KeyPostings.Find(Key);
+
+	const TMap<FString, FDialoguePostingList>* Values = KeyValuePostings.Find(Key);
+	return Values ? Values->Find(Value) : nullptr;
+}
+
+void FDialogueParameterIndex::Resolve(const TMap<FString, FString>& RequiredParameters,
+                                      const TMap<FString, FString>& ExcludedParameters,
+                                      FDialoguePostingList& OutLines) const
+{
+	check(RequiredParameters.Num() > 0);
+	OutLines.Reset();
+
+	// Gather the posting lists of all the required constraints. A single unknown constraint means no line can match
+	TArray<const FDialoguePostingList*, TInlineAllocator<8>> RequiredLists;
+	for (const TPair<FString, FString>& Parameter : RequiredParameters)
+	{
+		const FDialoguePostingList* List = Find(Parameter.Key, Parameter.Value);
+		if (!List || List->Num() == 0)
+			return;
+
+		RequiredLists.Add(List);
+	}
+
+	// Intersect starting from the shortest list, so that the intermediate results stay as small as possible
+	RequiredLists.Sort([](const FDialoguePostingList& A, const FDialoguePostingList& B) { return A.Num() < B.Num(); });
+
+	OutLines.Append(*RequiredLists[0]);
+	FDialoguePostingList& Scratch = ResolveScratch;
+	for (int32 ListIdx = 1; ListIdx < RequiredLists.Num() && OutLines.Num() > 0; ListIdx++)
+	{
+		FDialoguePostingListUtils::Intersect(OutLines, *RequiredLists[ListIdx], Scratch);
+		Swap(OutLines, Scratch);
+	}
+
+	for (const TPair<FString, FString>& Parameter : ExcludedParameters)
+	{
+		if (OutLines.Num() == 0)
+			return;
+
+		if (const FDialoguePostingList* List = Find(Parameter.Key, Parameter.Value))
+		{
+			FDialoguePostingListUtils::Subtract(OutLines, *List, Scratch);
+			Swap(OutLines, Scratch);
+		}
+	}
+}
+
+void FDialogueParameterIndex::BuildMask(const TMap<FString, FString>& RequiredParameters,
+                                        const TMap<FString, FString>& ExcludedParameters,
+                                        const int32 NumLines, FDialogueBitSet& OutMask) const
+{
+	if (RequiredParameters.Num() > 0)
+	{
+		// Excluded constraints are already subtracted by Resolve()
+		Resolve(RequiredParameters, ExcludedParameters, MaskScratch);
+
+		OutMask.Init(NumLines, false);
+		for (const int32 LineIdx : MaskScratch)
+			OutMask.Set(LineIdx);
+		return;
+	}
+
+	// Only exclusions - start from every line and knock out the excluded ones
+	OutMask.Init(NumLines, true);
+	for (const TPair<FString, FString>& Parameter : ExcludedParameters)
+	{
+		if (const FDialoguePostingList* List = Find(Parameter.Key, Parameter.Value))
+		{
+			for (const int32 LineIdx : *List)
+				OutMask.Clear(LineIdx);
+		}
+	}
+}
+
+int32 FDialogueParameterIndex::Estimate(const TMap<FString, FString>& RequiredParameters,
+                                       const TMap<FString, FString>& ExcludedParameters,
+                                       const int32 NumLines, int32& OutListCost) const
+{
+	OutListCost = 0;
+	int32 Estimate = NumLines;
+
+	// Required constraints can't match more lines than their shortest list
+	for (const TPair<FString, FString>& Parameter : RequiredParameters)
+	{
+		const FDialoguePostingList* List = Find(Parameter.Key, Parameter.Value);
+		const int32 Length = List ? List->Num() : 0;
+		Estimate = FMath::Min(Estimate, Length);
+		OutListCost += Length;
+	}
+
+	// Exclusions alone knock out at least their longest list
+	int32 LongestExcluded = 0;
+	for (const TPair<FString, FString>& Parameter : ExcludedParameters)
+	{
+		const FDialoguePostingList* List = Find(Parameter.Key, Parameter.Value);
+		const int32 Length = List ? List->Num() : 0;
+		LongestExcluded = FMath::Max(LongestExcluded, Length);
+		OutListCost += Length;
+	}
+
+	if (RequiredParameters.Num() == 0)
+		Estimate = FMath::Max(NumLines - LongestExcluded, 0);
+
+	return Estimate;
+}
+
+bool FDialogueParameterIndex::Matches(const UContextualDialogueLine* Line, const TMap<FString, FString>& RequiredParameters,
+                                      const TMap<FString, FString>& ExcludedParameters)
+{
+	auto HasParameter = [Line](const TPair<FString, FString>& Parameter)
+	{
+		const FString* Value = Line->Parameters.Find(Parameter.Key);
+		return Value && (Parameter.Value == Wildcard || *Value == Parameter.Value);
+	};
+
+	for (const TPair<FString, FString>& Parameter : RequiredParameters)
+	{
+		if (!HasParameter(Parameter))
+			return false;
+	}
+
+	for (const TPair<FString, FString>& Parameter : ExcludedParameters)
+	{
+		if (HasParameter(Parameter))
+			return false;
+	}
+
+	return true;
+}
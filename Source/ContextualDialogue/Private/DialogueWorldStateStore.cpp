@@ -0,0 +1,375 @@
+#include "DialogueWorldStateStore.h"
+
+void FDialogueWorldStateStore::Reset()
+{
+	ObjectIds.Empty();
+	Objects.Empty();
+	IntValues.Empty();
+	IntVersions.Empty();
+	IntPresent.Empty();
+	FloatValues.Empty();
+	FloatVersions.Empty();
+	FloatPresent.Empty();
+	StrValues.Empty();
+	StrIds.Empty();
+	StrVersions.Empty();
+	StrPresent.Empty();
+	StrIdLookup.Empty();
+	StrIdValues.Empty();
+	StrIdRefs.Empty();
+	FreeStrIds.Empty();
+	Version++;
+}
+
+int32 FDialogueWorldStateStore::FindObject(const FString& ObjectName) const
+{
+	const int32* ObjectIdx = ObjectIds.Find(ObjectName);
+	return ObjectIdx && Objects[*ObjectIdx].IsLive ? *ObjectIdx : INDEX_NONE;
+}
+
+int32 FDialogueWorldStateStore::FindOrAddObject(const FString& ObjectName)
+{
+	const int32 ObjectIdx = FindOrReserveObject(ObjectName);
+	if (!Objects[ObjectIdx].IsLive)
+	{
+		Objects[ObjectIdx].IsLive = true;
+		Stamp(ObjectIdx);
+	}
+	return ObjectIdx;
+}
+
+int32 FDialogueWorldStateStore::FindOrReserveObject(const FString& ObjectName)
+{
+	if (const int32* Existing = ObjectIds.Find(ObjectName))
+		return *Existing;
+
+	const int32 ObjectIdx = Objects.AddDefaulted();
+	Objects[ObjectIdx].Name = ObjectName;
+	ObjectIds.Add(ObjectName, ObjectIdx);
+	return ObjectIdx;
+}
+
+FDialogueVariableRef FDialogueWorldStateStore::BindVariable(const FString& ObjectName, const FString& VarName)
+{
+	const int32 NumReserved = Objects.Num() + IntValues.Num() + FloatValues.Num() + StrValues.Num();
+
+	FDialogueVariableRef Ref;
+	Ref.ObjectIdx = FindOrReserveObject(ObjectName);
+	Ref.IntSlot = FindOrAddIntSlot(Ref.ObjectIdx, VarName);
+	Ref.FloatSlot = FindOrAddFloatSlot(Ref.ObjectIdx, VarName);
+	Ref.StrSlot = FindOrAddStrSlot(Ref.ObjectIdx, VarName);
+
+	// No value changes, but copies of the store taken before don't have the new slots
+	if (Objects.Num() + IntValues.Num() + FloatValues.Num() + StrValues.Num() != NumReserved)
+		Version++;
+
+	return Ref;
+}
+
+FDialogueVariableRef FDialogueWorldStateStore::FindVariable(const FString& ObjectName, const FString& VarName) const
+{
+	FDialogueVariableRef Ref;
+	Ref.ObjectIdx = FindObject(ObjectName);
+	if (Ref.IsValid())
+	{
+		Ref.IntSlot = FindIntSlot(Ref.ObjectIdx, VarName);
+		Ref.FloatSlot = FindFloatSlot(Ref.ObjectIdx, VarName);
+		Ref.StrSlot = FindStrSlot(Ref.ObjectIdx, VarName);
+	}
+	return Ref;
+}
+
+void FDialogueWorldStateStore::TouchObject(const int32 ObjectIdx)
+{
+	Stamp(ObjectIdx);
+}
+
+int32 FDialogueWorldStateStore::FindIntSlot(const int32 ObjectIdx, const FString& VarName) const
+{
+	const int32* Slot = Objects[ObjectIdx].IntSlots.Find(VarName);
+	return Slot ? *Slot : INDEX_NONE;
+}
+
+int32 FDialogueWorldStateStore::FindFloatSlot(const int32 ObjectIdx, const FString& VarName) const
+{
+	const int32* Slot = Objects[ObjectIdx].FloatSlots.Find(VarName);
+	return Slot ? *Slot : INDEX_NONE;
+}
+
+int32 FDialogueWorldStateStore::FindStrSlot(const int32 ObjectIdx, const FString& VarName) const
+{
+	const int32* Slot = Objects[ObjectIdx].StrSlots.Find(VarName);
+	return Slot ? *Slot : INDEX_NONE;
+}
+
+const int32* FDialogueWorldStateStore::FindInt(const int32 ObjectIdx, const FString& VarName) const
+{
+	const int32 Slot = FindIntSlot(ObjectIdx, VarName);
+	return Slot != INDEX_NONE ? ReadInt(Slot) : nullptr;
+}
+
+const double* FDialogueWorldStateStore::FindFloat(const int32 ObjectIdx, const FString& VarName) const
+{
+	const int32 Slot = FindFloatSlot(ObjectIdx, VarName);
+	return Slot != INDEX_NONE ? ReadFloat(Slot) : nullptr;
+}
+
+const FString* FDialogueWorldStateStore::FindStr(const int32 ObjectIdx, const FString& VarName) const
+{
+	const int32 Slot = FindStrSlot(ObjectIdx, VarName);
+	return Slot != INDEX_NONE ? ReadStr(Slot) : nullptr;
+}
+
+const int32* FDialogueWorldStateStore::FindInt(const FString& ObjectName, const FString& VarName) const
+{
+	const int32 ObjectIdx = FindObject(ObjectName);
+	return ObjectIdx != INDEX_NONE ? FindInt(ObjectIdx, VarName) : nullptr;
+}
+
+const double* FDialogueWorldStateStore::FindFloat(const FString& ObjectName, const FString& VarName) const
+{
+	const int32 ObjectIdx = FindObject(ObjectName);
+	return ObjectIdx != INDEX_NONE ? FindFloat(ObjectIdx, VarName) : nullptr;
+}
+
+const FString* FDialogueWorldStateStore::FindStr(const FString& ObjectName, const FString& VarName) const
+{
+	const int32 ObjectIdx = FindObject(ObjectName);
+	return ObjectIdx != INDEX_NONE ? FindStr(ObjectIdx, VarName) : nullptr;
+}
+
+bool FDialogueWorldStateStore::ReadWhole(const FDialogueVariableRef& Ref, int32& OutValue, bool& bOutFraction) const
+{
+	if (const int32* IntValue = ReadInt(Ref))
+	{
+		OutValue = *IntValue;
+		bOutFraction = false;
+		return true;
+	}
+
+	if (const double* FloatValue = ReadFloat(Ref))
+	{
+		// Clamping keeps the comparisons right - a float above the integer range is above every integer literal too
+		const double Whole = FMath::Clamp(FMath::FloorToDouble(*FloatValue), static_cast<double>(MIN_int32), static_cast<double>(MAX_int32));
+		OutValue = static_cast<int32>(Whole);
+		bOutFraction = *FloatValue != Whole;
+		return true;
+	}
+
+	bOutFraction = false;
+	return ReadStrBool(Ref, OutValue);
+}
+
+bool FDialogueWorldStateStore::ReadStrBool(const FDialogueVariableRef& Ref, int32& OutValue) const
+{
+	const FString* StrValue = ReadStr(Ref);
+	if (!StrValue)
+		return false;
+
+	if (StrValue->Equals(TEXT("true"), ESearchCase::IgnoreCase))
+		OutValue = 1;
+	else if (StrValue->Equals(TEXT("false"), ESearchCase::IgnoreCase))
+		OutValue = 0;
+	else
+		return false;
+
+	return true;
+}
+
+bool FDialogueWorldStateStore::SetInt(const int32 ObjectIdx, const FString& VarName, const int32 Value)
+{
+	// A numeric variable is either an integer or a float, never both
+	const bool bRemovedFloat = RemoveFloat(ObjectIdx, VarName);
+
+	const int32 Slot = FindOrAddIntSlot(ObjectIdx, VarName);
+	if (IntPresent.Test(Slot) && IntValues[Slot] == Value)
+		return bRemovedFloat;
+
+	IntValues[Slot] = Value;
+	IntPresent.Set(Slot);
+	IntVersions[Slot] = Stamp(ObjectIdx);
+	return true;
+}
+
+bool FDialogueWorldStateStore::SetFloat(const int32 ObjectIdx, const FString& VarName, const double Value)
+{
+	const bool bRemovedInt = RemoveInt(ObjectIdx, VarName);
+
+	const int32 Slot = FindOrAddFloatSlot(ObjectIdx, VarName);
+	if (FloatPresent.Test(Slot) && FloatValues[Slot] == Value)
+		return bRemovedInt;
+
+	FloatValues[Slot] = Value;
+	FloatPresent.Set(Slot);
+	FloatVersions[Slot] = Stamp(ObjectIdx);
+	return true;
+}
+
+bool FDialogueWorldStateStore::SetStr(const int32 ObjectIdx, const FString& VarName, const FString& Value)
+{
+	const int32 Slot = FindOrAddStrSlot(ObjectIdx, VarName);
+	if (StrPresent.Test(Slot) && StrValues[Slot].Equals(Value, ESearchCase::CaseSensitive))
+		return false;
+
+	// Resolved once per change rather than once per comparison. The new id is acquired first, so that a value only
+	// changing case keeps its id
+	const int32 Id = AcquireStrId(Value);
+	if (StrPresent.Test(Slot))
+		ReleaseStrId(StrIds[Slot]);
+
+	StrValues[Slot] = Value;
+	StrIds[Slot] = Id;
+	StrPresent.Set(Slot);
+	StrVersions[Slot] = Stamp(ObjectIdx);
+	return true;
+}
+
+bool FDialogueWorldStateStore::SetName(const int32 ObjectIdx, const FString& VarName, const FName Value)
+{
+	return SetStr(ObjectIdx, VarName, Value.IsNone() ? FString() : Value.ToString());
+}
+
+bool FDialogueWorldStateStore::RemoveInt(const int32 ObjectIdx, const FString& VarName)
+{
+	const int32 Slot = FindIntSlot(ObjectIdx, VarName);
+	if (Slot == INDEX_NONE || !IntPresent.Test(Slot))
+		return false;
+
+	IntPresent.Clear(Slot);
+	IntVersions[Slot] = Stamp(ObjectIdx);
+	return true;
+}
+
+bool FDialogueWorldStateStore::RemoveFloat(const int32 ObjectIdx, const FString& VarName)
+{
+	const int32 Slot = FindFloatSlot(ObjectIdx, VarName);
+	if (Slot == INDEX_NONE || !FloatPresent.Test(Slot))
+		return false;
+
+	FloatPresent.Clear(Slot);
+	FloatVersions[Slot] = Stamp(ObjectIdx);
+	return true;
+}
+
+bool FDialogueWorldStateStore::RemoveStr(const int32 ObjectIdx, const FString& VarName)
+{
+	const int32 Slot = FindStrSlot(ObjectIdx, VarName);
+	if (Slot == INDEX_NONE || !StrPresent.Test(Slot))
+		return false;
+
+	ReleaseStrId(StrIds[Slot]);
+	StrPresent.Clear(Slot);
+	StrValues[Slot].Empty();
+	StrIds[Slot] = EmptyStrId;
+	StrVersions[Slot] = Stamp(ObjectIdx);
+	return true;
+}
+
+void FDialogueWorldStateStore::ExportObject(const int32 ObjectIdx, FObjectValueMapping& OutMapping) const
+{
+	const FStoreObject& Object = Objects[ObjectIdx];
+	OutMapping.Name = Object.Name;
+	OutMapping.IsMappedToActor = Object.IsMappedToActor;
+	OutMapping.ContextRef = Object.ContextRef;
+	OutMapping.CallbackNames = Object.CallbackNames;
+
+	OutMapping.IntVals.Reset();
+	ForEachInt(ObjectIdx, [&OutMapping](const FString& VarName, const int32 Value) { OutMapping.IntVals.Add(VarName, Value); });
+
+	OutMapping.FloatVals.Reset();
+	ForEachFloat(ObjectIdx, [&OutMapping](const FString& VarName, const double Value) { OutMapping.FloatVals.Add(VarName, Value); });
+
+	OutMapping.StrVals.Reset();
+	ForEachStr(ObjectIdx, [&OutMapping](const FString& VarName, const FString& Value) { OutMapping.StrVals.Add(VarName, Value); });
+}
+
+int32 FDialogueWorldStateStore::InternStrLiteral(const FString& Value)
+{
+	// Literals hold on to their ids for good, so an id a condition has been bound to is never handed to another string
+	return AcquireStrId(Value);
+}
+
+int32 FDialogueWorldStateStore::AcquireStrId(const FString& Value)
+{
+	if (Value.IsEmpty())
+		return EmptyStrId;
+
+	if (const int32* Existing = StrIdLookup.Find(Value))
+	{
+		StrIdRefs[*Existing - 1]++;
+		return *Existing;
+	}
+
+	int32 Id;
+	if (FreeStrIds.Num() > 0)
+	{
+		Id = FreeStrIds.Pop(false);
+		StrIdValues[Id - 1] = Value;
+		StrIdRefs[Id - 1] = 1;
+	}
+	else
+	{
+		StrIdValues.Add(Value);
+		Id = StrIdRefs.Add(1) + 1;
+	}
+
+	StrIdLookup.Add(Value, Id);
+	return Id;
+}
+
+void FDialogueWorldStateStore::ReleaseStrId(const int32 Id)
+{
+	if (Id == EmptyStrId || --StrIdRefs[Id - 1] > 0)
+		return;
+
+	StrIdLookup.Remove(StrIdValues[Id - 1]);
+	StrIdValues[Id - 1].Empty();
+	FreeStrIds.Add(Id);
+}
+
+uint64 FDialogueWorldStateStore::Stamp(const int32 ObjectIdx)
+{
+	Version++;
+	Objects[ObjectIdx].Version = Version;
+	return Version;
+}
+
+int32 FDialogueWorldStateStore::FindOrAddIntSlot(const int32 ObjectIdx, const FString& VarName)
+{
+	int32 Slot = FindIntSlot(ObjectIdx, VarName);
+	if (Slot == INDEX_NONE)
+	{
+		Slot = IntValues.AddZeroed();
+		IntVersions.Add(0);
+		IntPresent.SetNum(IntValues.Num());
+		Objects[ObjectIdx].IntSlots.Add(VarName, Slot);
+	}
+	return Slot;
+}
+
+int32 FDialogueWorldStateStore::FindOrAddFloatSlot(const int32 ObjectIdx, const FString& VarName)
+{
+	int32 Slot = FindFloatSlot(ObjectIdx, VarName);
+	if (Slot == INDEX_NONE)
+	{
+		Slot = FloatValues.AddZeroed();
+		FloatVersions.Add(0);
+		FloatPresent.SetNum(FloatValues.Num());
+		Objects[ObjectIdx].FloatSlots.Add(VarName, Slot);
+	}
+	return Slot;
+}
+
+int32 FDialogueWorldStateStore::FindOrAddStrSlot(const int32 ObjectIdx, const FString& VarName)
+{
+	int32 Slot = FindStrSlot(ObjectIdx, VarName);
+	if (Slot == INDEX_NONE)
+	{
+		Slot = StrValues.AddDefaulted();
+		StrIds.Add(EmptyStrId);
+		StrVersions.Add(0);
+		StrPresent.SetNum(StrValues.Num());
+		Objects[ObjectIdx].StrSlots.Add(VarName, Slot);
+	}
+	return Slot;
+}
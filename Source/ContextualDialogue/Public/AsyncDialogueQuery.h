@@ -0,0 +1,59 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DialogueManagerUtils.h"
+#include "Kismet/BlueprintAsyncActionBase.h"
+#include "AsyncDialogueQuery.generated.h"
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnAsyncDialogueQueryCompleted, const TArray<UContextualDialogueLine*>&, Lines, bool, RequestedNumOfLinesFound);
+
+/*
+ *	Latent Blueprint node running UDialogueManagerSubsystem::GetLinesForCurrentContextAsync(). The query is scored on a
+ *	worker thread, the Completed pin fires on the game thread once the results are in
+ */
+UCLASS()
+class CONTEXTUALDIALOGUE_API UAsyncDialogueQuery : public UBlueprintAsyncActionBase
+{
+	GENERATED_BODY()
+
+public:
+	/** Fired on the game thread with the lines returned by the query */
+	UPROPERTY(BlueprintAssignable)
+	FOnAsyncDialogueQueryCompleted Completed;
+
+	/**
+	 *  Get multiple lines of dialogue given current world state, without blocking the game thread while scoring
+	 *
+	 *  @param	WorldContextObject	Object used to find the dialogue subsystem
+	 *  @param	NoLines				How many lines should be returned
+	 *  @param	QueryCategories		Categories to pass to the query (lines without matching categories won't even be considered)
+	 *  @param	RequiredParameters	Parameters (key-value) the lines must have ('*' matches any value)
+	 *  @param	ExcludedParameters	Parameters (key-value) the lines must NOT have ('*' matches any value)
+	 *  @param	ProcessCallbacks	Should callbacks of selected lines be processed once the results are delivered?
+	 */
+	UFUNCTION(BlueprintCallable, meta = (BlueprintInternalUseOnly = "true", WorldContext = "WorldContextObject",
+		AutoCreateRefTerm = "QueryCategories, RequiredParameters, ExcludedParameters"), Category = "DialogueSubsystem")
+	static UAsyncDialogueQuery* GetLinesForCurrentContextAsync(
+		UObject* WorldContextObject,
+		const int NoLines,
+		const TArray<FQueryCategory>& QueryCategories,
+		const TMap<FString, FString>& RequiredParameters,
+		const TMap<FString, FString>& ExcludedParameters,
+		bool ProcessCallbacks);
+
+	virtual void Activate() override;
+
+private:
+	UPROPERTY()
+	TObjectPtr<UObject> WorldContext;
+
+	int NumLines = 1;
+	TArray<FQueryCategory> Categories;
+	TMap<FString, FString> Required;
+	TMap<FString, FString> Excluded;
+	bool bProcessCallbacks = false;
+
+	void HandleQueryCompleted(const TArray<UContextualDialogueLine*>& Lines);
+};
@@ -26,6 +26,17 @@ public:
 	
 	UPROPERTY(BlueprintReadOnly, EditAnywhere, config, Category = "DialogueSubsystem", meta = (DisplayName = "Dialogue database location (JSON)", FilePathFilter="json"))
 	FFilePath dialogueDbPath;
+
+	/** Queries with at least this many candidate lines are scored on worker threads. 0 disables parallel scoring */
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, config, Category = "DialogueSubsystem|Performance", meta = (DisplayName = "Candidate lines needed for parallel scoring", ClampMin = "0"))
+	int32 ParallelScoringLineThreshold = 8192;
+
+	/**
+	 *	Re-read every dialogue component before each query, for projects that change DSS_ variables directly without
+	 *	calling MarkDialogueVarDirty(). Costs a read and a compare of every DSS_ variable of every registered actor per query
+	 */
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, config, Category = "DialogueSubsystem|Performance", meta = (DisplayName = "Poll dialogue components on every query"))
+	bool bPollWorldStateOnQuery = false;
 	
 	/**
 	 *  Returns the full dialogue DB path, handles the case of it being relative
@@ -0,0 +1,184 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ *	A dense bit set over dialogue lines. Each line in the database owns one bit (its DenseIndex), and every stage of a
+ *	query (filters, parameters, categories) produces one of these. Stages are then combined a whole 64-bit word at a
+ *	time, and only the bits that survive are visited when scoring.
+ *
+ *	TBitArray would do the job as well, but it has no AND NOT and no cheap set bit iteration, both of which the query
+ *	pipeline lives on.
+ */
+class FDialogueBitSet
+{
+public:
+	FDialogueBitSet() : NumBits(0) {}
+	explicit FDialogueBitSet(const int32 InNumBits, const bool bValue = false) : NumBits(0) { Init(InNumBits, bValue); }
+
+	/** Resize the set to InNumBits and set every bit to bValue */
+	void Init(const int32 InNumBits, const bool bValue)
+	{
+		NumBits = InNumBits;
+		Words.Reset();
+		Words.AddUninitialized(NumWordsFor(InNumBits));
+		FMemory::Memset(Words.GetData(), bValue ? 0xFF : 0x00, Words.Num() * sizeof(uint64));
+		ClearTrailingBits();
+	}
+
+	/** Resize the set to InNumBits. Existing bits are kept, new bits are cleared */
+	void SetNum(const int32 InNumBits)
+	{
+		const int32 OldNumWords = Words.Num();
+		const int32 NewNumWords = NumWordsFor(InNumBits);
+		Words.SetNum(NewNumWords);
+		for (int32 WordIdx = OldNumWords; WordIdx < NewNumWords; WordIdx++)
+			Words[WordIdx] = 0;
+
+		NumBits = InNumBits;
+		ClearTrailingBits();
+	}
+
+	/** Make this an exact copy of Other. Unlike assignment, the words already allocated are reused whenever they fit */
+	void CopyFrom(const FDialogueBitSet& Other)
+	{
+		NumBits = Other.NumBits;
+		Words.Reset();
+		Words.Append(Other.Words);
+	}
+
+	/** Clear all the bits and release the memory */
+	void Empty()
+	{
+		Words.Empty();
+		NumBits = 0;
+	}
+
+	FORCEINLINE int32 Num() const { return NumBits; }
+
+	FORCEINLINE void Set(const int32 Index)
+	{
+		checkSlow(Index >= 0 && Index < NumBits);
+		Words[Index >> 6] |= uint64(1) << (Index & 63);
+	}
+
+	FORCEINLINE void Clear(const int32 Index)
+	{
+		checkSlow(Index >= 0 && Index < NumBits);
+		Words[Index >> 6] &= ~(uint64(1) << (Index & 63));
+	}
+
+	FORCEINLINE bool Test(const int32 Index) const
+	{
+		checkSlow(Index >= 0 && Index < NumBits);
+		return (Words[Index >> 6] >> (Index & 63)) & 1;
+	}
+
+	/** this = this & Other. Both sets have to be of the same size */
+	void And(const FDialogueBitSet& Other)
+	{
+		check(Other.NumBits == NumBits);
+		uint64* RESTRICT Dst = Words.GetData();
+		const uint64* RESTRICT Src = Other.Words.GetData();
+		for (int32 WordIdx = 0; WordIdx < Words.Num(); WordIdx++)
+			Dst[WordIdx] &= Src[WordIdx];
+	}
+
+	/** this = this & ~Other. Both sets have to be of the same size */
+	void AndNot(const FDialogueBitSet& Other)
+	{
+		check(Other.NumBits == NumBits);
+		uint64* RESTRICT Dst = Words.GetData();
+		const uint64* RESTRICT Src = Other.Words.GetData();
+		for (int32 WordIdx = 0; WordIdx < Words.Num(); WordIdx++)
+			Dst[WordIdx] &= ~Src[WordIdx];
+	}
+
+	/** this = this | Other. Both sets have to be of the same size */
+	void Or(const FDialogueBitSet& Other)
+	{
+		check(Other.NumBits == NumBits);
+		uint64* RESTRICT Dst = Words.GetData();
+		const uint64* RESTRICT Src = Other.Words.GetData();
+		for (int32 WordIdx = 0; WordIdx < Words.Num(); WordIdx++)
+			Dst[WordIdx] |= Src[WordIdx];
+	}
+
+	/** Number of bits currently set */
+	int32 CountSetBits() const
+	{
+		int32 Count = 0;
+		for (const uint64 Word : Words)
+			Count += FMath::CountBits(Word);
+		return Count;
+	}
+
+	/** True if no bit is set */
+	bool IsEmpty() const
+	{
+		for (const uint64 Word : Words)
+		{
+			if (Word)
+				return false;
+		}
+		return true;
+	}
+
+	/**
+	 *	Call Func(int32 Index) for every set bit, in ascending order. Empty words are skipped at once, so sparse sets are
+	 *	cheap to walk.
+	 */
+	template<typename FuncType>
+	FORCEINLINE void ForEachSetBit(FuncType&& Func) const
+	{
+		ForEachSetBitInWords(0, Words.Num(), Func);
+	}
+
+	/**
+	 *	Call Func(int32 Index) for every set bit within words [FirstWord, EndWord), in ascending order. Word ranges are
+	 *	what parallel consumers split the set by - two ranges never share a word, so they can modify their bits of
+	 *	another set of the same size without stepping on each other.
+	 */
+	template<typename FuncType>
+	FORCEINLINE void ForEachSetBitInWords(const int32 FirstWord, const int32 EndWord, FuncType&& Func) const
+	{
+		for (int32 WordIdx = FirstWord; WordIdx < EndWord; WordIdx++)
+		{
+			uint64 Word = Words[WordIdx];
+			while (Word)
+			{
+				const int32 Bit = static_cast<int32>(FMath::CountTrailingZeros64(Word));
+				Func((WordIdx << 6) + Bit);
+				Word &= Word - 1;
+			}
+		}
+	}
+
+	/** Number of 64-bit words backing the set */
+	FORCEINLINE int32 NumWords() const { return Words.Num(); }
+
+	/** Overwrite a whole 64-bit word, e.g. with a mask produced by a vectorized kernel. Bits past Num are dropped */
+	FORCEINLINE void SetWord(const int32 WordIdx, const uint64 Word)
+	{
+		Words[WordIdx] = Word;
+		if (WordIdx == Words.Num() - 1)
+			ClearTrailingBits();
+	}
+
+	/** Raw access to the underlying words */
+	FORCEINLINE const TArray<uint64>& GetWords() const { return Words; }
+
+private:
+	TArray<uint64> Words;
+	int32 NumBits;
+
+	static FORCEINLINE int32 NumWordsFor(const int32 InNumBits) { return (InNumBits + 63) >> 6; }
+
+	/** Keep the bits past NumBits at zero, so that counting and iterating never report them */
+	void ClearTrailingBits()
+	{
+		const int32 UsedInLastWord = NumBits & 63;
+		if (UsedInLastWord != 0 && Words.Num() > 0)
+			Words.Last() &= (uint64(1) << UsedInLastWord) - 1;
+	}
+};
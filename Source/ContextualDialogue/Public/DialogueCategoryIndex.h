@@ -0,0 +1,146 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DialogueBitSet.h"
+#include "DialogueManagerUtils.h"
+#include "DialoguePostingList.h"
+
+/** Interned ids of the categories requested by a query, INDEX_NONE for categories no line belongs to */
+typedef TArray<int32, TInlineAllocator<8>> FDialogueCategoryIds;
+
+/**
+ *	Index of the categories of dialogue lines. Every distinct category name-value pair is interned into a small id
+ *	which owns a posting list of its lines, so a query asking for several categories resolves them with linear-time
+ *	unions (any-of) or intersections (all-of) - a line belonging to more than one of them still shows up once.
+ *
+ *	Category tags share the same ids, but a line is added to the posting list of its tag as well as to the lists of
+ *	all the tag's parents. A hierarchical query (Bark.Combat matching Bark.Combat.Reload) is then a single lookup.
+ */
+class CONTEXTUALDIALOGUE_API FDialogueCategoryIndex
+{
+public:
+	/** Drop all the categories and their posting lists */
+	void Reset();
+
+	/**
+	 *	Add a line to a category, interning the category if it is new
+	 *
+	 *	@param LineIdx	Dense index of the line
+	 *	@param Name		Category name
+	 *	@param Value	Category value
+	 */
+	void AddLine(const int32 LineIdx, const FString& Name, const FString& Value);
+
+	/**
+	 *	Add a line to a category tag and to all of its parent tags, interning the ones that are new
+	 *
+	 *	@param LineIdx	Dense index of the line
+	 *	@param Tag		Category tag of the line
+	 */
+	void AddLineTag(const int32 LineIdx, const FGameplayTag& Tag);
+
+	/**
+	 *	Remove a line from all of its categories. Category ids stay interned
+	 *
+	 *	@param LineIdx	Dense index of the line
+	 */
+	void RemoveLine(const int32 LineIdx);
+
+	/**
+	 *	Get the posting list of a single category
+	 *
+	 *	@param Name		Category name
+	 *	@param Value	Category value
+	 *	@return Lines belonging to the category, nullptr if there are none
+	 */
+	const FDialoguePostingList* Find(const FString& Name, const FString& Value) const;
+
+	/**
+	 *	Get the posting list of a requested category, by its tag if it has one
+	 *
+	 *	@param Category	Category requested by a query
+	 *	@return Lines belonging to the category (or to any tag below it), nullptr if there are none
+	 */
+	const FDialoguePostingList* Find(const FQueryCategory& Category) const;
+
+	/**
+	 *	Look up the ids of the requested categories, once per query rather than once per line
+	 *
+	 *	@param[in]	QueryCategories	Categories requested by a query
+	 *	@param[out]	OutIds			One id per requested category, duplicates removed
+	 */
+	void FindIds(const TArray<FQueryCategory>& QueryCategories, FDialogueCategoryIds& OutIds) const;
+
+	/**
+	 *	Estimate how many lines belong to the requested categories, from the posting list lengths only
+	 *
+	 *	@param QueryCategories	Categories requested by a query
+	 *	@param Match			How the categories combine
+	 *	@param NumLines			Number of lines in the database
+	 *	@param OutListCost		Total length of the posting lists involved, i.e. the cost of resolving the categories
+	 *	@return Upper bound of the matching lines
+	 */
+	int32 Estimate(const TArray<FQueryCategory>& QueryCategories, const EDialogueCategoryMatch Match, const int32 NumLines,
+	               int32& OutListCost) const;
+
+	/**
+	 *	Check a single line against already looked up category ids, without touching the posting lists
+	 *
+	 *	@param LineIdx	Dense index of the line
+	 *	@param Ids		Ids of the requested categories, see FindIds()
+	 *	@param Match	How the categories combine
+	 *	@return True if the line belongs to the requested categories
+	 */
+	bool Matches(const int32 LineIdx, const FDialogueCategoryIds& Ids, const EDialogueCategoryMatch Match) const;
+
+	/**
+	 *	Resolve the requested categories into a posting list
+	 *
+	 *	@param[in]	QueryCategories	Categories requested by a query. Must not be empty
+	 *	@param[in]	Match			How the categories combine
+	 *	@param[out]	OutLines		Sorted dense indices of the matching lines, each of them exactly once
+	 */
+	void Resolve(const TArray<FQueryCategory>& QueryCategories, const EDialogueCategoryMatch Match,
+	             FDialoguePostingList& OutLines) const;
+
+	/**
+	 *	Resolve the requested categories into a line mask
+	 *
+	 *	@param[in]	QueryCategories	Categories requested by a query
+	 *	@param[in]	Match			How the categories combine
+	 *	@param[in]	NumLines		Size of the dense line index
+	 *	@param[out]	OutMask			Set with one bit per matching line
+	 */
+	void BuildMask(const TArray<FQueryCategory>& QueryCategories, const EDialogueCategoryMatch Match, const int32 NumLines,
+	               FDialogueBitSet& OutMask) const;
+
+	/** Number of distinct categories interned so far */
+	FORCEINLINE int32 NumCategories() const { return Postings.Num(); }
+
+private:
+	/** Category name -> category value -> category id */
+	TMap<FString, TMap<FString, int32>> CategoryIds;
+
+	/** Category tag -> category id, covering every tag that is a line's tag or one of its parents */
+	TMap<FGameplayTag, int32> TagIds;
+
+	/** Category id -> lines belonging to the category */
+	TArray<FDialoguePostingList> Postings;
+
+	/** Dense line index -> ids of the categories the line belongs to */
+	TArray<TArray<int32, TInlineAllocator<4>>> LineCategories;
+
+	/** Intermediate lists of Resolve() and BuildMask(), the index is only ever queried from the game thread */
+	mutable FDialoguePostingList ResolveScratch;
+	mutable FDialoguePostingList MaskScratch;
+
+	/** Id of a requested category, INDEX_NONE if no line belongs to it */
+	int32 FindCategoryId(const FQueryCategory& Category) const;
+
+	/** Add a line to the posting list of an interned category */
+	void AddLineToCategory(const int32 LineIdx, const int32 CategoryId);
+
+	/** Gather the posting lists of the requested categories, shortest first. False if no line can match */
+	bool GatherLists(const TArray<FQueryCategory>& QueryCategories, const EDialogueCategoryMatch Match,
+	                 TArray<const FDialoguePostingList*, TInlineAllocator<8>>& OutLists) const;
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ *	Everything the Dialogue System needs to know about the reflection data of an actor class: its DSS_ prefixed
+ *	variables and its DSS_ prefixed callbacks, keyed by their names without the prefix.
+ *
+ *	Variables are picked up by their native type. Integers and booleans (as 0 and 1) go into the integer lane of the
+ *	World State, floats and doubles into the float lane, strings into the string lane. Names, enums (by the short name
+ *	of the enumerator) and gameplay tags go into the string lane as already interned names.
+ *
+ *	Descriptors are built on the first request for a class and then shared by every actor of that class, so spawning a
+ *	crowd of identical NPCs walks the class fields once rather than once per NPC. Reads, writes and callback dispatch
+ *	become a single map lookup followed by an offset-based access through the cached property.
+ */
+struct CONTEXTUALDIALOGUE_API FDialogueClassDescriptor
+{
+	/** Variable name (without "DSS_") -> integer property */
+	TMap<FString, const FIntProperty*> IntProperties;
+
+	/** Variable name (without "DSS_") -> string property */
+	TMap<FString, const FStrProperty*> StrProperties;
+
+	/** Variable name (without "DSS_") -> boolean property */
+	TMap<FString, const FBoolProperty*> BoolProperties;
+
+	/** Variable name (without "DSS_") -> float or double property */
+	TMap<FString, const FNumericProperty*> FloatProperties;
+
+	/** Variable name (without "DSS_") -> name, enum or gameplay tag property, see ReadName() */
+	TMap<FString, const FProperty*> NameProperties;
+
+	/** Callback name (without "DSS_") -> function, including the ones inherited from super classes */
+	TMap<FString, UFunction*> Callbacks;
+
+	/** Callback names in declaration order, as registered with the World State */
+	TArray<FString> CallbackNames;
+
+	/**
+	 *	Get the descriptor of a class, building it if this is the first request. Game thread only
+	 *
+	 *	@param Class	Class of the actor owning a dialogue context component
+	 *	@return Descriptor shared by every actor of the class
+	 */
+	static const FDialogueClassDescriptor& Get(const UClass* Class);
+
+	/**
+	 *	Drop every cached descriptor. Happens on its own whenever classes are reinstanced or reloaded, the references
+	 *	returned by Get() must therefore never be kept beyond the current call
+	 */
+	static void Invalidate();
+
+	/**
+	 *	Read one of the NameProperties as a name
+	 *
+	 *	@param Property		Name, enum or gameplay tag property
+	 *	@param Container	Object owning the property
+	 *	@return The name, the authored name of the enumerator (its short name for native enums) or the tag name.
+	 *			NAME_None for invalid values
+	 */
+	static FName ReadName(const FProperty* Property, const void* Container);
+
+	/**
+	 *	Write one of the NameProperties from a name
+	 *
+	 *	@param Property		Name, enum or gameplay tag property
+	 *	@param Container	Object owning the property
+	 *	@param Value		New value - a name, an enumerator (authored, short or full name) or a registered gameplay tag
+	 *	@return False if the value is not valid for the property, which is then left unchanged
+	 */
+	static bool WriteName(const FProperty* Property, void* Container, const FName Value);
+
+private:
+	/**
+	 *	Class the descriptor was built from. Guards against a new class allocated at the address of a garbage collected
+	 *	one - recompiled Blueprints keep their class, those are handled by Invalidate()
+	 */
+	TWeakObjectPtr<const UClass> SourceClass;
+
+	/** Walk the fields of a class and fill in the descriptor */
+	void Build(const UClass* Class);
+
+	/** Whether a property is read and written as a name, see NameProperties */
+	static bool IsNameProperty(const FProperty* Property);
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DialogueContextComponent.h"
+
+/**
+ *	Dense registry of the dialogue context components subscribed with the Dialogue System. Every component remembers the
+ *	slot it occupies, so adding and removing one is O(1) - a removed component's slot is refilled with the last one
+ *	instead of shifting the whole array, which keeps streaming thousands of actors in and out linear.
+ *
+ *	Iteration order is not stable across removals.
+ */
+class FDialogueComponentRegistry
+{
+public:
+	/**
+	 *	Add a component to the registry
+	 *
+	 *	@param ContextComponent	Component to add
+	 *	@return False if the component is already registered
+	 */
+	bool Add(UDialogueContextComponent* ContextComponent)
+	{
+		check(ContextComponent);
+		if (Contains(ContextComponent))
+			return false;
+
+		ContextComponent->RegistrySlot = Components.Add(ContextComponent);
+		return true;
+	}
+
+	/**
+	 *	Remove a component from the registry
+	 *
+	 *	@param ContextComponent	Component to remove
+	 *	@return False if the component wasn't registered
+	 */
+	bool Remove(UDialogueContextComponent* ContextComponent)
+	{
+		check(ContextComponent);
+		if (!Contains(ContextComponent))
+			return false;
+
+		const int32 Slot = ContextComponent->RegistrySlot;
+		Components.RemoveAtSwap(Slot, 1, false);
+		if (Components.IsValidIndex(Slot))
+			Components[Slot]->RegistrySlot = Slot;
+
+		ContextComponent->RegistrySlot = INDEX_NONE;
+		return true;
+	}
+
+	/** True if the component is registered here */
+	FORCEINLINE bool Contains(const UDialogueContextComponent* ContextComponent) const
+	{
+		return Components.IsValidIndex(ContextComponent->RegistrySlot) && Components[ContextComponent->RegistrySlot] == ContextComponent;
+	}
+
+	/**
+	 *	Unregister all the components. Their slots aren't touched, as they may already be gone - a stale slot is never
+	 *	mistaken for a registration, since Contains() checks what the slot actually holds
+	 */
+	void Empty() { Components.Empty(); }
+
+	FORCEINLINE int32 Num() const { return Components.Num(); }
+
+	/** Ranged-for support, over the registered components in slot order */
+	FORCEINLINE TArray<UDialogueContextComponent*>::RangedForIteratorType begin() { return Components.begin(); }
+	FORCEINLINE TArray<UDialogueContextComponent*>::RangedForIteratorType end() { return Components.end(); }
+	FORCEINLINE TArray<UDialogueContextComponent*>::RangedForConstIteratorType begin() const { return Components.begin(); }
+	FORCEINLINE TArray<UDialogueContextComponent*>::RangedForConstIteratorType end() const { return Components.end(); }
+
+private:
+	TArray<UDialogueContextComponent*> Components;
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DialogueBitSet.h"
+#include "DialogueManagerUtils.h"
+#include "DialoguePostingList.h"
+#include "DialogueWorldStateStore.h"
+
+/**
+ *	Partitions the dialogue lines by one of their equality conditions that can't be unmet without the line being out
+ *	(critical conditions and filters), e.g. "World.Speaker = Bob". Every line is placed into the partition of its most
+ *	selective such condition, the rest goes into an unpartitioned remainder. A query then only has to look at the
+ *	partitions matching the current values of the partition variables, plus the remainder - everything else would be
+ *	dropped by its key condition anyway, so it is skipped before any condition is evaluated.
+ */
+class CONTEXTUALDIALOGUE_API FDialogueConditionPartitions
+{
+public:
+	/** Drop all the partitions */
+	void Reset();
+
+	/**
+	 *	Add a line to the unpartitioned remainder. The line has to have its DenseIndex assigned already
+	 *
+	 *	@param Line	Line to add
+	 */
+	void AddLine(const UContextualDialogueLine* Line);
+
+	/**
+	 *	Remove a line from whichever partition it is in
+	 *
+	 *	@param Line	Line that has been removed from the database
+	 */
+	void RemoveLine(const UContextualDialogueLine* Line);
+
+	/**
+	 *	Pick the partition key of every line and rebuild the partitions. Selectivity is only known once the whole
+	 *	database is there, so this is done after loading rather than line by line.
+	 *
+	 *	@param Lines	All the lines indexed by their DenseIndex, nullptr for deleted lines
+	 */
+	void Rebuild(const TArray<UContextualDialogueLine*>& Lines);
+
+	/**
+	 *	Mark every line that can still be fulfilled given the current values of the partition variables
+	 *
+	 *	@param[in]	State		World State to read the partition variables from
+	 *	@param[in]	NumLines	Number of lines, i.e. size of the output set
+	 *	@param[out]	OutMask		Set with one bit per line
+	 */
+	void BuildMask(const FDialogueWorldStateStore& State, const int32 NumLines, FDialogueBitSet& OutMask) const;
+
+	/**
+	 *	Count the lines BuildMask() would mark, without building the mask
+	 *
+	 *	@param State	World State to read the partition variables from
+	 *	@return Number of lines in the remainder and in the matching partitions
+	 */
+	int32 CountMatches(const FDialogueWorldStateStore& State) const;
+
+	/**
+	 *	Check a single line the way BuildMask() would
+	 *
+	 *	@param LineIdx	Dense index of the line
+	 *	@param State	World State to read the line's partition variable from
+	 *	@return True if the line's partition matches (or it has none)
+	 */
+	bool IsLineViable(const int32 LineIdx, const FDialogueWorldStateStore& State) const;
+
+	/** Number of lines placed into a partition (i.e. not in the remainder) */
+	FORCEINLINE int32 NumPartitionedLines() const { return NumPartitioned; }
+
+private:
+	/** All the partitions keyed by values of a single variable */
+	struct FPartitionedVariable
+	{
+		FString ObjectId;
+		FString VariableId;
+
+		/** Store slots of the variable, bound when its first key condition was added */
+		FDialogueVariableRef Ref;
+
+		/** Partitions of integer literals, matched against the integer variable (or a float one without a fraction) */
+		TMap<int32, FDialoguePostingList> IntPartitions;
+
+		/**
+		 *	Partitions of string literals keyed by their string ids, matched against the id of the value of the
+		 *	string variable (a missing one reads as EmptyStrId, like an empty string)
+		 */
+		TMap<int32, FDialoguePostingList> StrPartitions;
+	};
+
+	/** Lines without a suitable key condition */
+	FDialogueBitSet Remainder;
+
+	/** Object name -> variable name -> index into Variables */
+	TMap<FString, TMap<FString, int32>> VariableLookup;
+	TArray<FPartitionedVariable> Variables;
+
+	/** Dense line index -> condition the line is partitioned by, an invalid reference for the remainder */
+	TArray<FDialogueCondition> LineKeys;
+
+	int32 NumPartitioned = 0;
+
+	/** Whether a condition can serve as a partition key */
+	static bool IsKeyCandidate(const FDialogueCondition& Condition, const bool bIsFilter);
+
+	/** Find the posting list a condition partitions its lines into, optionally creating it */
+	FDialoguePostingList* FindPartition(const FDialogueCondition& Condition, const bool bCreate);
+};
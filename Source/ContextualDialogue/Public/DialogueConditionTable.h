@@ -0,0 +1,147 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DialogueBitSet.h"
+#include "DialogueManagerUtils.h"
+
+class FDialogueDependencyGraph;
+
+/**
+ *	Interns every distinct condition of the database ("Object.Variable", operator, literal), no matter how many lines
+ *	repeat it. The lines then only refer to their conditions by id (FDialogueCondition::TableId), and every distinct
+ *	condition is evaluated once per change of the variable it reads, into a single bit. Scoring a line boils down to
+ *	testing those bits.
+ *
+ *	Integer conditions, the bulk of any systemic database, are compiled into a structure of arrays (variable slot,
+ *	accepted orderings, constant) and evaluated all at once with vector compares, four at a time. Float variables take
+ *	part too, read as their whole part plus a fraction flag, which keeps the compares against integer literals exact.
+ *	String conditions (compared by string id) and the rare fractional literals remain one by one, each only when
+ *	its variable has changed - staleness comes from the dependency graph versions.
+ */
+class CONTEXTUALDIALOGUE_API FDialogueConditionTable
+{
+public:
+	/**
+	 *	Reads an integer (or float) World State variable by its resolved slots, returns false if it has no value.
+	 *	See FDialogueWorldStateStore::ReadWhole() for how a float is read
+	 */
+	typedef TFunctionRef<bool(const FDialogueVariableRef& Ref, int32& OutValue, bool& bOutFraction)> FReadIntFunc;
+
+	/** Evaluates a single string or fractional condition against the current World State */
+	typedef TFunctionRef<bool(const FDialogueCondition& Condition)> FEvaluateFunc;
+
+	/** Drop all the conditions. Has to go together with a reset of the dependency graph, the variable ids come from it */
+	void Reset();
+
+	/**
+	 *	Find the id of an identical condition, or add the condition to the table. Also assigns Condition.TableId
+	 *
+	 *	@param Condition	Compiled condition to intern, with its VariableRef bound to the World State store
+	 *	@param Graph		Dependency graph providing the id of the variable the condition reads
+	 *	@return Id of the condition, INDEX_NONE for invalid references (those are never fulfilled)
+	 */
+	int32 Intern(FDialogueCondition& Condition, FDialogueDependencyGraph& Graph);
+
+	/**
+	 *	Evaluate all the conditions whose variables have changed since they were last evaluated
+	 *
+	 *	@param Graph		Dependency graph the conditions were interned with
+	 *	@param ReadInt		Reads the current value of an integer or float variable
+	 *	@param Evaluate		Evaluates a single string or fractional condition against the current World State
+	 */
+	void Refresh(const FDialogueDependencyGraph& Graph, FReadIntFunc ReadInt, FEvaluateFunc Evaluate);
+
+	/** Result of a condition as of the last Refresh() */
+	FORCEINLINE bool IsFulfilled(const int32 TableId) const
+	{
+		if (TableId == INDEX_NONE)
+			return false;
+
+		return (TableId & 1) ? StrResults.Test(TableId >> 1) : IntResults.Test(TableId >> 1);
+	}
+
+	/**
+	 *	Check a list of filters from the evaluated bits
+	 *
+	 *	@param Filters	Interned filters of a line
+	 *	@return True if all the filters are fulfilled
+	 */
+	bool AreAllFulfilled(const TArray<FDialogueCondition>& Filters) const;
+
+	/** Number of distinct conditions */
+	FORCEINLINE int32 Num() const { return NumIntConditions + StrConditions.Num(); }
+
+private:
+	/** Identity of a condition, case-insensitive like the comparisons themselves */
+	struct FConditionKey
+	{
+		FString ObjectId;
+		FString VariableId;
+		FString Value;
+		uint8 ConditionType;
+
+		bool operator==(const FConditionKey& Other) const
+		{
+			return ConditionType == Other.ConditionType && ObjectId == Other.ObjectId &&
+				VariableId == Other.VariableId && Value == Other.Value;
+		}
+
+		friend uint32 GetTypeHash(const FConditionKey& Key)
+		{
+			uint32 Hash = GetTypeHash(Key.ObjectId);
+			Hash = HashCombine(Hash, GetTypeHash(Key.VariableId));
+			Hash = HashCombine(Hash, GetTypeHash(Key.Value));
+			return HashCombine(Hash, ::GetTypeHash(Key.ConditionType));
+		}
+	};
+
+	/** Condition -> id. Ids are (index << 1) for integer conditions and (index << 1) | 1 for string conditions */
+	TMap<FConditionKey, int32> Lookup;
+
+	/*
+	 *	Integer variables read by the integer conditions ("slots"), gathered from the World State whenever the dependency
+	 *	graph reports them changed
+	 */
+	TMap<int32, int32> SlotLookup;
+	TArray<int32> SlotGraphIds;
+	TArray<FDialogueVariableRef> SlotRefs;
+	TArray<uint64> SlotGatheredVersions;
+	TArray<int32> SlotValues;
+	TArray<int32> SlotPresent;
+	TArray<int32> SlotFraction;
+
+	/*
+	 *	Integer conditions as a structure of arrays, padded to a multiple of the vector width. Orderings are stored as
+	 *	0 / ~0 masks, so that an operator is just a combination of the three compares (e.g. LET = Less | Equal).
+	 *	Padding entries accept nothing, so they never produce a set bit.
+	 */
+	int32 NumIntConditions = 0;
+	TArray<int32> IntSlots;
+	TArray<int32> IntConstants;
+	TArray<int32> IntAcceptLess;
+	TArray<int32> IntAcceptEqual;
+	TArray<int32> IntAcceptGreater;
+
+	/** Scratch arrays the slot values are gathered into before the vector pass */
+	TArray<int32> IntGathered;
+	TArray<int32> IntGatheredPresent;
+	TArray<int32> IntGatheredFraction;
+
+	/** One bit per integer condition */
+	FDialogueBitSet IntResults;
+
+	/** String conditions and conditions with fractional literals, evaluated one by one */
+	TArray<FDialogueCondition> StrConditions;
+	TArray<int32> StrVariableIds;
+	TArray<uint64> StrEvaluatedVersions;
+	FDialogueBitSet StrResults;
+
+	/** Graph version of the last Refresh(), nothing needs to be evaluated until the graph moves on. 0 forces a refresh */
+	uint64 RefreshedVersion = 0;
+
+	/** Re-read the slots that changed, returns true if any of them did */
+	bool GatherSlots(const FDialogueDependencyGraph& Graph, FReadIntFunc ReadInt);
+
+	/** Evaluate every integer condition into IntResults */
+	void EvaluateIntConditions();
+};
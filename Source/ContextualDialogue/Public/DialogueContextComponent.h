@@ -6,21 +6,31 @@
 #include "Components/ActorComponent.h"
 #include "DialogueContextComponent.generated.h"
 
+class FDialogueComponentRegistry;
+class UDialogueManagerSubsystem;
+struct FDialogueClassDescriptor;
+
 DECLARE_DYNAMIC_MULTICAST_DELEGATE(FDialogueComponentLoaded);
 DECLARE_LOG_CATEGORY_EXTERN(DialogueContextComponent, Log, All);
 
 /**
  *	This class implements the "Dialogue context component". Each actor with such component will be registered with the Dialogue System.
  *
- *	The class itself doesn't expose any functionality, the only logic executed is contained within the BeginPlay() function.
  *	When a play session is started - this component will poll all the variables for its owning actor and register them under
- *	that Actor's name (more specifically - DSS_Name) with the Dialogue System.
+ *	that Actor's name (more specifically - DSS_Name) with the Dialogue System. From then on, the Dialogue System doesn't
+ *	poll the actor anymore - changes have to be pushed, either through the SetDialogue*Var() setters or by calling
+ *	MarkDialogueVarDirty() after changing a DSS_ variable directly.
+ *
+ *	The component keeps no copy of the variables - they are always read from the actor through the cached properties of
+ *	its class, and copied only when the World State takes a snapshot of them.
  */
 UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
 class CONTEXTUALDIALOGUE_API UDialogueContextComponent : public UActorComponent
 {
 	GENERATED_BODY()
 
+	friend class FDialogueComponentRegistry;
+
 public:	
 	UDialogueContextComponent();
 	
@@ -28,16 +38,25 @@ public:
 	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
 	
+	/** Snapshot of the integer DSS_ variables of the owning actor */
 	TMap<FString, int> GetIntVars() { return PopulateIntStateVariables(); }
-	TMap<FString, FString> GetStrVars() const { return StrVars; }
-	TArray<FString> GetCallbackNames() const { return CallbackNames; }
+	/** Snapshot of the string DSS_ variables of the owning actor */
+	TMap<FString, FString> GetStrVars() { return PopulateStrStateVariables(); }
+	const TArray<FString>& GetCallbackNames() { return GetClassDescriptor().CallbackNames; }
 	FString GetDSSName() const { return DSS_Name; }
 
+	/**
+	 *	Get the reflection data of the owning actor's class, shared with every other actor of that class. Looked up on
+	 *	every call, as recompiling the class drops it - don't keep the reference around
+	 */
+	const FDialogueClassDescriptor& GetClassDescriptor();
+
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "DSS_Name")
 	FString DSS_Name = "";
 	
 	/**
-	 *	Update the value of a string variable in this component's owning actor
+	 *	Update the value of a string variable in this component's owning actor. Name, enum and gameplay tag variables
+	 *	are set from the string as well
 	 *
 	 * @param VarName	Name of the variable to be updated
 	 * @param NewVal	New value to be given to the variable
@@ -45,13 +64,80 @@ public:
 	void UpdateStrValue(FString VarName, FString NewVal);
 
 	/**
-	 *	Update the value of an integer variable in this component's owning actor
+	 *	Update the value of an integer variable in this component's owning actor. Boolean variables are set from it as
+	 *	well, anything but 0 being true
 	 *
 	 * @param VarName	Name of the variable to be updated
 	 * @param NewVal	New value to be given to the variable
 	 */
 	void UpdateIntValue(FString VarName, int NewVal);
 
+	/**
+	 *	Update the value of a float variable in this component's owning actor
+	 *
+	 * @param VarName	Name of the variable to be updated
+	 * @param NewVal	New value to be given to the variable
+	 */
+	void UpdateFloatValue(const FString& VarName, const double NewVal);
+
+	/**
+	 *	Whether a DSS_ variable may end up with a different value than it was updated with: names, enums and gameplay
+	 *	tags refuse invalid values, booleans turn any number into true or false. Such variables have to be re-read
+	 *	(see MarkDialogueVarDirty()) after an update, rather than pushing the value they were updated with
+	 *
+	 *	@param VarName	Name of the variable, without the "DSS_" prefix
+	 */
+	bool IsDialogueVarConstrained(const FString& VarName);
+
+	/**
+	 *	Set an integer DSS_ variable of the owning actor and push the new value to the Dialogue System
+	 *
+	 *	@param VarName	Name of the variable, without the "DSS_" prefix
+	 *	@param NewVal	New value of the variable
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Dialogue")
+	void SetDialogueIntVar(const FString& VarName, const int32 NewVal);
+
+	/**
+	 *	Set a string DSS_ variable of the owning actor and push the new value to the Dialogue System
+	 *
+	 *	@param VarName	Name of the variable, without the "DSS_" prefix
+	 *	@param NewVal	New value of the variable
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Dialogue")
+	void SetDialogueStrVar(const FString& VarName, const FString& NewVal);
+
+	/**
+	 *	Set a float DSS_ variable of the owning actor and push the new value to the Dialogue System
+	 *
+	 *	@param VarName	Name of the variable, without the "DSS_" prefix
+	 *	@param NewVal	New value of the variable
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Dialogue")
+	void SetDialogueFloatVar(const FString& VarName, const double NewVal);
+
+	/**
+	 *	Set a boolean DSS_ variable of the owning actor and push the new value to the Dialogue System
+	 *
+	 *	@param VarName	Name of the variable, without the "DSS_" prefix
+	 *	@param NewVal	New value of the variable
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Dialogue")
+	void SetDialogueBoolVar(const FString& VarName, const bool NewVal);
+
+	/**
+	 *	Re-read a single DSS_ variable of the owning actor and push it to the Dialogue System. Call this after changing
+	 *	the variable directly, otherwise the Dialogue System keeps seeing its old value
+	 *
+	 *	@param VarName	Name of the variable, without the "DSS_" prefix
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Dialogue")
+	void MarkDialogueVarDirty(const FString& VarName);
+
+	/** Re-read all the DSS_ variables of the owning actor and push them to the Dialogue System */
+	UFUNCTION(BlueprintCallable, Category = "Dialogue")
+	void MarkAllDialogueVarsDirty();
+
 	/** Called when this context component has been updated from a loaded game */
 	UPROPERTY(BlueprintAssignable)
 	FDialogueComponentLoaded OnDialogueComponentLoaded;
@@ -60,9 +146,6 @@ public:
 
 protected:
 	AActor* Owner;
-	TMap<FString, int> IntVars;
-	TMap<FString, FString> StrVars;
-	TArray<FString> CallbackNames;
 
 	/**
 	 *	Get all the initial values of integer variables that should be registered with the Dialogue System
@@ -85,4 +168,11 @@ protected:
 	 */
 	TArray<FString> PopulateCallbackStateVariables();
 
+	/** Get the Dialogue System this component is registered with, nullptr if it's not running */
+	UDialogueManagerSubsystem* GetDialogueSubsystem() const;
+
+private:
+	/** Slot of this component in the Dialogue System's component registry, INDEX_NONE when it isn't registered */
+	int32 RegistrySlot = INDEX_NONE;
+
 };
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DialogueBitSet.h"
+#include "DialoguePostingList.h"
+
+class UContextualDialogueLine;
+
+/**
+ *	Tracks which dialogue lines depend on which world variables ("Object.Variable" pairs referenced by their conditions
+ *	and filters). Whenever a variable changes, the lines reading it are marked dirty, so a query only has to re-score
+ *	those and can take everything else from the line cache.
+ *
+ *	Every change also advances a global version. Variables remember the version at which they last changed and cached
+ *	results remember the version at which they were computed, which lets us double check the dirty tracking.
+ */
+class CONTEXTUALDIALOGUE_API FDialogueDependencyGraph
+{
+public:
+	/** Drop all the dependencies and start over with NumLines lines, all of them dirty */
+	void Reset(const int32 NumLines);
+
+	/**
+	 *	Register the dependencies of a line. The line has to have its DenseIndex assigned already
+	 *
+	 *	@param Line	Line whose conditions and filters should be tracked
+	 */
+	void AddLine(const UContextualDialogueLine* Line);
+
+	/**
+	 *	Stop tracking a line
+	 *
+	 *	@param Line	Line that has been removed from the database
+	 */
+	void RemoveLine(const UContextualDialogueLine* Line);
+
+	/**
+	 *	A single variable has changed - mark the lines depending on it dirty
+	 *
+	 *	@param ObjectName	Name of the World State object owning the variable
+	 *	@param VarName		Name of the variable
+	 */
+	void MarkVariableDirty(const FString& ObjectName, const FString& VarName);
+
+	/**
+	 *	A whole object has appeared, disappeared or been reloaded - mark the lines depending on any of its variables dirty
+	 *
+	 *	@param ObjectName	Name of the World State object
+	 */
+	void MarkObjectDirty(const FString& ObjectName);
+
+	/** Something changed in a way we can't track - every line has to be re-scored */
+	void MarkAllDirty();
+
+	/**
+	 *	Mark every line reading a given variable
+	 *
+	 *	@param[in]	ObjectName	Name of the World State object owning the variable
+	 *	@param[in]	VarName		Name of the variable
+	 *	@param[out]	OutMask		Set with one bit per tracked line
+	 */
+	void BuildVariableMask(const FString& ObjectName, const FString& VarName, FDialogueBitSet& OutMask) const;
+
+	/**
+	 *	Get the id of a variable, creating it if necessary. Ids are stable until the next Reset()
+	 *
+	 *	@param ObjectName	Name of the World State object owning the variable
+	 *	@param VarName		Name of the variable
+	 *	@return Id of the variable
+	 */
+	int32 FindOrAddVariable(const FString& ObjectName, const FString& VarName);
+
+	/** Global version at which a variable has last changed */
+	FORCEINLINE uint64 GetVariableVersion(const int32 VariableId) const { return VariableVersions[VariableId]; }
+
+	/** Lines whose cached results can no longer be trusted */
+	FORCEINLINE FDialogueBitSet& GetDirtyLines() { return DirtyLines; }
+	FORCEINLINE const FDialogueBitSet& GetDirtyLines() const { return DirtyLines; }
+
+	/** Current version of the world state, as seen by the graph */
+	FORCEINLINE uint64 GetVersion() const { return GlobalVersion; }
+
+	/**
+	 *	Check whether any variable read by a line has changed after a given version
+	 *
+	 *	@param LineIndex	Dense index of the line
+	 *	@param Version		Version at which the line's cached result was computed
+	 *	@return True if the cached result is stale
+	 */
+	bool IsLineStale(const int32 LineIndex, const uint64 Version) const;
+
+private:
+	/** Object name -> variable name -> variable id */
+	TMap<FString, TMap<FString, int32>> VariableIds;
+
+	/** Variable id -> lines reading the variable */
+	TArray<FDialoguePostingList> Dependents;
+
+	/** Variable id -> global version at which the variable has last changed */
+	TArray<uint64> VariableVersions;
+
+	/** Dense line index -> ids of the variables read by the line */
+	TArray<TArray<int32>> LineVariables;
+
+	/** Lines that need to be re-scored */
+	FDialogueBitSet DirtyLines;
+
+	/** Advanced by every change */
+	uint64 GlobalVersion = 0;
+
+	/** Mark a single variable id as changed */
+	void MarkVariableIdDirty(const int32 VariableId);
+};
@@ -3,18 +3,100 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "Async/Future.h"
 #include "DialogueContextComponent.h"
 #include "Subsystems/GameInstanceSubsystem.h"
+#include "DialogueBitSet.h"
+#include "DialogueCategoryIndex.h"
+#include "DialogueComponentRegistry.h"
+#include "DialogueConditionPartitions.h"
+#include "DialogueConditionTable.h"
+#include "DialogueDependencyGraph.h"
 #include "DialogueManagerUtils.h"
+#include "DialogueParameterIndex.h"
+#include "DialoguePreparedQuery.h"
+#include "DialogueQueryPlan.h"
+#include "DialogueTopKSelector.h"
+#include "DialogueWorldStateStore.h"
 #include "DialogueManagerSubsystem.generated.h"
 
 DECLARE_LOG_CATEGORY_EXTERN(DialogueManagerSubsystem, Log, All);
 
 typedef TArray<UContextualDialogueLine*> FDialogueDB;
 typedef TMap<FString, UContextualDialogueLine*> FDialogueLookupTable;
-DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnDialogueQueryFinished, TArray<FLineScore>, Scores, TArray<UContextualDialogueLine*>, Lines);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_ThreeParams(FOnDialogueQueryFinished, TArray<FLineScore>, Scores, TArray<UContextualDialogueLine*>, Lines, TArray<FDialogueLineMatchCapture>, Matches);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnWorldStateUpdated, const TArray<FObjectValueMapping>&, WorldState);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE(FOnDialogueAndWorldStateLoaded);
+DECLARE_DELEGATE_OneParam(FOnDialogueAsyncQueryCompleted, const TArray<UContextualDialogueLine*>& /* Lines */);
+
+/** Cached result of scoring a single line, kept until one of the variables the line reads changes */
+struct FDialogueLineCacheEntry
+{
+	/** Score the line got when it was last evaluated */
+	FLineScore Score;
+
+	/** FDialogueDependencyGraph version at which the line was last evaluated */
+	uint64 Version = 0;
+};
+
+/**
+ *	Working memory of a query. The subsystem owns a single instance and every query resets and refills it, so once the
+ *	buffers have grown to fit the largest query, the steady state doesn't touch the heap at all
+ */
+/** Score of a line of a speaker batch without its speaker conditions, see UDialogueManagerSubsystem::GetLinesForSpeakers() */
+struct FDialogueSpeakerPartialScore
+{
+	int32 NumMatched = 0;
+	bool bRejected = false;
+};
+
+struct FDialogueQueryScratch
+{
+	/** Lines surviving the query stages */
+	FDialogueBitSet Candidates;
+
+	/** Mask produced by the query stage currently being executed */
+	FDialogueBitSet StageMask;
+
+	/** Candidates whose cached scores can be used as they are */
+	FDialogueBitSet CleanCandidates;
+
+	/** Candidates that have to be re-evaluated */
+	FDialogueBitSet DirtyCandidates;
+
+	/** Order in which the dirty candidates are scored, one array per parallel chunk (just the first one when serial) */
+	TArray<TArray<int32>> DirtyOrders;
+
+	/** Top-K of every parallel scoring chunk */
+	TArray<FDialogueTopKSelector> ChunkTopK;
+
+	/** Top-K of the whole query */
+	FDialogueTopKSelector TopK;
+
+	/** Dense indices of the selected lines, sorted */
+	TArray<int32> BestLineIndices;
+
+	/** Lines matching the parameters and categories of GetLinesWithParametersForCurrentContext() */
+	FDialoguePostingList ParameterMatches;
+	FDialoguePostingList CategoryMatches;
+	FDialoguePostingList MergedMatches;
+
+	/** Packed top-K keys of the lines collected by GetLinesWithParametersForCurrentContext() */
+	TArray<uint64> LineKeys;
+
+	/** Lines reading "World.Speaker", for GetLinesForSpeakers() */
+	FDialogueBitSet SpeakerLines;
+
+	/** Candidates of every query of a speaker batch. Never shrunk, only the first Queries.Num() are meaningful */
+	TArray<FDialogueBitSet> QueryCandidates;
+
+	/** Speaker lines among the candidates of any query of the batch, and their partial scores in bit order */
+	FDialogueBitSet SpeakerCandidates;
+	TArray<FDialogueSpeakerPartialScore> PartialScores;
+
+	/** Candidates of the current query of the batch not reading the speaker */
+	FDialogueBitSet SharedCandidates;
+};
 
 const FString SAVE_DIR = "DialogueSaveGames";
 const FString DB_SAVE_NAME = "Dialogue.json";
@@ -31,7 +113,10 @@ class CONTEXTUALDIALOGUE_API UDialogueManagerSubsystem : public UGameInstanceSub
 	GENERATED_BODY()
 	
 public:
-	/** Broadcast whenever a requested query is finished running and some dialogue is returned */
+	/**
+	 *	Broadcast whenever a requested query is finished running and some dialogue is returned. Editor only - the debug
+	 *	data (scores and per-condition matches of every scored line) is only captured while something is listening
+	 */
 	FOnDialogueQueryFinished OnDialogueQueryFinished;
 
 	/** Broadcast whenever the world state changes */
@@ -52,18 +137,150 @@ public:
 	 *  @param[out]	OutLines					Holds lines returned by the query
 	 *  @param[out] RequestedNumOfLinesFound	Returns true if the number of lines returned matches the requested NoLines
 	 *  @param[out]	ActualNumOfLinesFound		The actual number of lines returned by this query
+	 *  @param[in]	CategoryMatch				Whether the lines have to belong to any or to all of the QueryCategories
 	 */
 	UFUNCTION(BlueprintCallable, meta = (AutoCreateRefTerm="QueryCategories, RequiredParameters, ExcludedParameters"))
 	void GetLinesForCurrentContext(
 		const int NoLines,
-		TArray<FQueryCategory> QueryCategories,
-		TMap<FString, FString> RequiredParameters,
-		TMap<FString, FString> ExcludedParameters,
+		const TArray<FQueryCategory>& QueryCategories,
+		const TMap<FString, FString>& RequiredParameters,
+		const TMap<FString, FString>& ExcludedParameters,
+		bool ProcessCallbacks,
+		TArray<UContextualDialogueLine*>& OutLines,
+		bool& RequestedNumOfLinesFound,
+		int& ActualNumOfLinesFound,
+		EDialogueCategoryMatch CategoryMatch = EDialogueCategoryMatch::AnyOf);
+
+	/**
+	 *  Get multiple lines of dialogue given current world state, keeping only the lines whose CategoryTags satisfy a
+	 *  gameplay tag query. For plain hierarchical matching (e.g. Bark.Combat matching Bark.Combat.Reload), prefer
+	 *  GetLinesForCurrentContext() with FQueryCategory::CategoryTag set - those are resolved through the category index
+	 *  instead of line by line
+	 *
+	 *  @param[in]	NoLines						How many lines should be returned
+	 *  @param[in]	TagQuery					Query the CategoryTags of the lines have to match, an empty query matches all
+	 *  @param[in]	RequiredParameters			Parameters (key-value) the lines must have ('*' matches any value)
+	 *  @param[in]	ExcludedParameters			Parameters (key-value) the lines must NOT have ('*' matches any value)
+	 *  @param[in]	ProcessCallbacks			Should callbacks of selected lines be processed immediately upon selection?
+	 *  @param[out]	OutLines					Holds lines returned by the query
+	 *  @param[out] RequestedNumOfLinesFound	Returns true if the number of lines returned matches the requested NoLines
+	 *  @param[out]	ActualNumOfLinesFound		The actual number of lines returned by this query
+	 */
+	UFUNCTION(BlueprintCallable, meta = (AutoCreateRefTerm="TagQuery, RequiredParameters, ExcludedParameters"))
+	void GetLinesForTagQuery(
+		const int NoLines,
+		const FGameplayTagQuery& TagQuery,
+		const TMap<FString, FString>& RequiredParameters,
+		const TMap<FString, FString>& ExcludedParameters,
 		bool ProcessCallbacks,
 		TArray<UContextualDialogueLine*>& OutLines,
 		bool& RequestedNumOfLinesFound,
 		int& ActualNumOfLinesFound);
 
+	/**
+	 *  Asynchronous version of GetLinesForCurrentContext(). The World State is polled and snapshotted right away (the
+	 *  snapshot is shared with the other queries until the World State changes), the filtering, scoring and top-K
+	 *  selection then run on a worker task. Results are always delivered on the game thread,
+	 *  where the callbacks of the returned lines get processed as well (if requested). Lines deleted from the database
+	 *  while the query was running are dropped from the results. Blueprints use UAsyncDialogueQuery instead.
+	 *
+	 *  @param	NoLines				How many lines should be returned
+	 *  @param	QueryCategories		Categories to pass to the query (lines without matching categories won't even be considered)
+	 *  @param	RequiredParameters	Parameters (key-value) the lines must have ('*' matches any value)
+	 *  @param	ExcludedParameters	Parameters (key-value) the lines must NOT have ('*' matches any value)
+	 *  @param	ProcessCallbacks	Should callbacks of selected lines be processed once the results are delivered?
+	 *  @param	OnCompleted			Optional delegate executed on the game thread with the results
+	 *  @param	CategoryMatch		Whether the lines have to belong to any or to all of the QueryCategories
+	 *  @return	Future fulfilled with the results on the game thread, right before OnCompleted is executed
+	 */
+	TFuture<TArray<UContextualDialogueLine*>> GetLinesForCurrentContextAsync(
+		const int NoLines,
+		const TArray<FQueryCategory>& QueryCategories,
+		const TMap<FString, FString>& RequiredParameters,
+		const TMap<FString, FString>& ExcludedParameters,
+		bool ProcessCallbacks,
+		FOnDialogueAsyncQueryCompleted OnCompleted = FOnDialogueAsyncQueryCompleted(),
+		EDialogueCategoryMatch CategoryMatch = EDialogueCategoryMatch::AnyOf);
+
+	/**
+	 *  Describe how a query would narrow down its candidate lines right now: the order its stages would run in, how
+	 *  each of them would be applied, and how many lines would survive every stage. Nothing gets scored
+	 *
+	 *  @param	QueryCategories		Categories to pass to the query
+	 *  @param	RequiredParameters	Parameters (key-value) the lines must have ('*' matches any value)
+	 *  @param	ExcludedParameters	Parameters (key-value) the lines must NOT have ('*' matches any value)
+	 *  @param	CategoryMatch		Whether the lines have to belong to any or to all of the QueryCategories
+	 *  @return	Human readable plan, e.g. "Live lines: 40000 -> Categories (mask, estimated 12) = 12 -> ..."
+	 */
+	UFUNCTION(BlueprintCallable, meta = (AutoCreateRefTerm="QueryCategories, RequiredParameters, ExcludedParameters"))
+	FString ExplainQuery(
+		const TArray<FQueryCategory>& QueryCategories,
+		const TMap<FString, FString>& RequiredParameters,
+		const TMap<FString, FString>& ExcludedParameters,
+		EDialogueCategoryMatch CategoryMatch = EDialogueCategoryMatch::AnyOf);
+
+	/**
+	 *  Resolve the categories and parameters of a query once, so that it can be executed over and over again without
+	 *  any setup cost (e.g. by an AI barking every few seconds). See FDialoguePreparedQuery
+	 *
+	 *  @param	NoLines				How many lines the query should return
+	 *  @param	QueryCategories		Categories to pass to the query (lines without matching categories won't even be considered)
+	 *  @param	RequiredParameters	Parameters (key-value) the lines must have ('*' matches any value)
+	 *  @param	ExcludedParameters	Parameters (key-value) the lines must NOT have ('*' matches any value)
+	 *  @param	CategoryMatch		Whether the lines have to belong to any or to all of the QueryCategories
+	 *  @return	The prepared query
+	 */
+	UFUNCTION(BlueprintCallable, meta = (AutoCreateRefTerm="QueryCategories, RequiredParameters, ExcludedParameters"))
+	FDialoguePreparedQuery PrepareQuery(
+		const int NoLines,
+		const TArray<FQueryCategory>& QueryCategories,
+		const TMap<FString, FString>& RequiredParameters,
+		const TMap<FString, FString>& ExcludedParameters,
+		EDialogueCategoryMatch CategoryMatch = EDialogueCategoryMatch::AnyOf);
+
+	/**
+	 *  Execute a prepared query against the current world state. Same results as GetLinesForCurrentContext() called
+	 *  with the inputs the query was prepared from
+	 *
+	 *  @param[in,out]	Query						Query to execute, prepared again first if the database was reloaded
+	 *  @param[in]		ProcessCallbacks			Should callbacks of selected lines be processed immediately upon selection?
+	 *  @param[out]		OutLines					Holds lines returned by the query
+	 *  @param[out]		RequestedNumOfLinesFound	Returns true if the number of lines returned matches the requested NoLines
+	 *  @param[out]		ActualNumOfLinesFound		The actual number of lines returned by this query
+	 */
+	UFUNCTION(BlueprintCallable)
+	void ExecutePreparedQuery(
+		UPARAM(ref) FDialoguePreparedQuery& Query,
+		bool ProcessCallbacks,
+		TArray<UContextualDialogueLine*>& OutLines,
+		bool& RequestedNumOfLinesFound,
+		int& ActualNumOfLinesFound);
+
+	/**
+	 *  Check whether a prepared query still matches the loaded database
+	 *
+	 *  @param	Query	Query to check
+	 *  @return	True if the query can be executed without being prepared again
+	 */
+	UFUNCTION(BlueprintPure)
+	bool IsPreparedQueryValid(const FDialoguePreparedQuery& Query) const;
+
+	/**
+	 *  Run several queries, each for a different speaker, in one go. The World State is polled once for the whole batch,
+	 *  and everything that doesn't depend on "World.Speaker" is evaluated once and shared between the queries - only
+	 *  the speaker conditions and filters are evaluated per query, against the speaker of the query rather than the
+	 *  World State. "World.Speaker" itself is never modified.
+	 *
+	 *  Callbacks (if requested) are processed after the whole batch has been evaluated, so they can't affect the results
+	 *  of the other queries in the batch.
+	 *
+	 *  @param[in]	Queries				Queries to run
+	 *  @param[in]	ProcessCallbacks	Should callbacks of selected lines be processed immediately upon selection?
+	 *  @param[out]	OutResults			One entry per query, in the same order as Queries
+	 */
+	UFUNCTION(BlueprintCallable)
+	void GetLinesForSpeakers(const TArray<FDialogueQueryDescriptor>& Queries, bool ProcessCallbacks, TArray<FDialogueQueryResult>& OutResults);
+
 	/**
 	 *  Get a single best line for current world context
 	 *
@@ -73,28 +290,34 @@ public:
 	 *  @param[in]	ProcessCallbacks			Should callbacks of selected lines be processed immediately upon selection?
 	 *  @param[out]	FoundLine					Was the line found?
 	 *  @param[out]	Line						LineObject
+	 *  @param[in]	CategoryMatch				Whether the line has to belong to any or to all of the QueryCategories
 	 */
 	UFUNCTION(BlueprintCallable, meta = (AutoCreateRefTerm="QueryCategories, RequiredParameters, ExcludedParameters"))
 	void GetBestLine(
-		TArray<FQueryCategory> QueryCategories,
-		TMap<FString, FString> RequiredParameters,
-		TMap<FString, FString> ExcludedParameters,
+		const TArray<FQueryCategory>& QueryCategories,
+		const TMap<FString, FString>& RequiredParameters,
+		const TMap<FString, FString>& ExcludedParameters,
 		bool ProcessCallbacks,
 		bool& FoundLine,
-		UContextualDialogueLine*& Line);
+		UContextualDialogueLine*& Line,
+		EDialogueCategoryMatch CategoryMatch = EDialogueCategoryMatch::AnyOf);
 
 	/**
-	 *  Get multiple lines of dialogue given current world state and having the parameters given.
+	 *  Get all the lines of dialogue having the parameters given that score above 0 in the current world state, in the
+	 *  same order GetLinesForCurrentContext() returns them. The parameters are resolved first, so the cost of the query
+	 *  follows the number of lines having them rather than the size of the database.
 	 *  @param[in]	QueryCategories Categories to pass to the query (lines without matching categories won't even be considered)
-	 *  @param[in] Parameters Parameters to look for as a map {"ParameterName": "ParameterValue"}
+	 *  @param[in] Parameters Parameters to look for as a map {"ParameterName": "ParameterValue"}. A '*' value matches any value.
 	 *  @param[out] OutLines Holds lines returned by the query
+	 *  @param[in] CategoryMatch Whether the lines have to belong to any or to all of the QueryCategories
 	 *  @return True if at least a line was found.
 	 */
 	UFUNCTION(BlueprintCallable, meta = (AutoCreateRefTerm="Categories"))
 	bool GetLinesWithParametersForCurrentContext(
 		TArray<FQueryCategory> QueryCategories,
 		TMap<FString, FString> Parameters,
-		TArray<UContextualDialogueLine*>& OutLines);
+		TArray<UContextualDialogueLine*>& OutLines,
+		EDialogueCategoryMatch CategoryMatch = EDialogueCategoryMatch::AnyOf);
 	
 	/**
 	 *	This is a bit of a hack-y function to get around our "prompts" that we display. In normal circumstances, this
@@ -154,21 +377,74 @@ public:
 	FString GetVariable(const FString& VarName, const FString& Scope = "World");
 
 	/**
-	 *	Return the current world state
+	 *	Return the current world state. This is a view rebuilt from the World State store, changes made to it are not
+	 *	reflected back - use SetWorldVariable() instead
 	 *
 	 * @return the world state representation as a map of objects tracked by the dialogue system
 	 */
 	UFUNCTION(BlueprintCallable)
-	TMap<FString, FObjectValueMapping>& GetWorldState() { return WorldState; }
+	TMap<FString, FObjectValueMapping>& GetWorldState() { RefreshWorldStateView(); return WorldState; }
 
 	/** Initialize the world state with starting values */
 	UFUNCTION()
 	void PopulateWorldState();
 
-	/** Poll all dialogue components and update their values in the World State */
+	/**
+	 *	Bring the World State up to date before a query. Components push their changes as they happen, so this only
+	 *	notifies the listeners if anything changed since the last call - unless polling is enabled in the settings, in
+	 *	which case every dialogue component is re-read first
+	 */
 	UFUNCTION()
 	void UpdateWorldState();
 
+	/**
+	 *	Push a new value of an integer variable into the World State. Only marks the dependent lines dirty if the value
+	 *	actually changed
+	 *
+	 *	@param ObjectName	Name of the object owning the variable
+	 *	@param VarName		Name of the variable
+	 *	@param NewVal		New value of the variable
+	 */
+	void PushIntValue(const FString& ObjectName, const FString& VarName, const int NewVal);
+
+	/**
+	 *	Push a new value of a string variable into the World State. Only marks the dependent lines dirty if the value
+	 *	actually changed
+	 *
+	 *	@param ObjectName	Name of the object owning the variable
+	 *	@param VarName		Name of the variable
+	 *	@param NewVal		New value of the variable
+	 */
+	void PushStrValue(const FString& ObjectName, const FString& VarName, const FString& NewVal);
+
+	/**
+	 *	Push a new value of a float variable into the World State. Only marks the dependent lines dirty if the value
+	 *	actually changed
+	 *
+	 *	@param ObjectName	Name of the object owning the variable
+	 *	@param VarName		Name of the variable
+	 *	@param NewVal		New value of the variable
+	 */
+	void PushFloatValue(const FString& ObjectName, const FString& VarName, const double NewVal);
+
+	/**
+	 *	Push a new value of a name, enum or gameplay tag variable into the World State, where it is kept as an already
+	 *	interned string. Only marks the dependent lines dirty if the value actually changed
+	 *
+	 *	@param ObjectName	Name of the object owning the variable
+	 *	@param VarName		Name of the variable
+	 *	@param NewVal		New value of the variable
+	 */
+	void PushNameValue(const FString& ObjectName, const FString& VarName, const FName NewVal);
+
+	/**
+	 *	Push all the cached variables of a dialogue component into the World State, adding the component if it isn't
+	 *	tracked yet
+	 *
+	 *	@param ContextComponent	Component to push
+	 */
+	void PushComponentState(UDialogueContextComponent* ContextComponent);
+
 	/**
 	 *	Return the value of an additional parameter (kept in the Parameters dict)
 	 *
@@ -185,10 +461,29 @@ public:
 	 *	@param	Line	Line to score
 	 *	@return Score achieved by the line, expressed as a FLineScore structure
 	 */
-	FLineScore GetLineScore(UContextualDialogueLine* Line) const;
+	FLineScore GetLineScore(const UContextualDialogueLine* Line) const;
+
+	/**
+	 *	Check whether all the filters of a line are fulfilled, given a current World State
+	 *
+	 *	@param	Line	Line to check
+	 *	@return True if every filter is fulfilled (or the line has none), False otherwise
+	 */
+	bool AreFiltersFulfilled(const UContextualDialogueLine* Line) const;
 
+	/**
+	 *	Check a single compiled condition against the current World State. Has no side effects, so it is safe to call
+	 *	from scoring worker threads
+	 *
+	 *	@param	Condition	Condition to check, has to be compiled (see FDialogueCondition::Compile())
+	 *	@return True if the condition is met, False otherwise
+	 */
+	bool IsConditionFulfilled(const FDialogueCondition& Condition) const;
 
-	bool IsConditionFulfilled(FDialogueCondition& Condition) const;
+	/** Same as the member functions above, but evaluated against an arbitrary World State (e.g. an async query snapshot) */
+	static FLineScore GetLineScore(const UContextualDialogueLine* Line, const FDialogueWorldStateStore& State);
+	static bool AreFiltersFulfilled(const UContextualDialogueLine* Line, const FDialogueWorldStateStore& State);
+	static bool IsConditionFulfilled(const FDialogueCondition& Condition, const FDialogueWorldStateStore& State);
 	
 	/**
 	 *	Subscribes a new dialogue component with the system
@@ -204,6 +499,24 @@ public:
 	 */
 	void UnsubscribeDSSComponent(UDialogueContextComponent* ContextComponent);
 
+	/**
+	 *	Subscribe a batch of dialogue components, e.g. everything in a streamed in level cell. Each component costs O(1)
+	 *	plus a read of its variables, and the World State listeners are notified once for the whole batch. A component
+	 *	whose DSS_Name is already in the World State takes the object over, and the values of its actor replace the
+	 *	stored ones
+	 *
+	 *	@param ContextComponents	Components to subscribe. Already subscribed ones are skipped
+	 */
+	void RegisterComponents(TArrayView<UDialogueContextComponent* const> ContextComponents);
+
+	/**
+	 *	Remove a batch of dialogue components, e.g. everything in a streamed out level cell. Their variables stay in the
+	 *	World State, but are no longer mapped to an actor until a component with the same DSS_Name subscribes again
+	 *
+	 *	@param ContextComponents	Components to remove. Ones that aren't subscribed are skipped
+	 */
+	void UnregisterComponents(TArrayView<UDialogueContextComponent* const> ContextComponents);
+
 	/**
 	 *	Prints a json object's string representation to the console output
 	 *
@@ -297,7 +610,7 @@ protected:
 	TSharedPtr<FJsonObject> JsonParsed;
 
 	/** Holds the list of all the DSS components already subscribed*/
-	TArray<UDialogueContextComponent*> DSS_Components;
+	FDialogueComponentRegistry DSS_Components;
 
 	/** List of all the dialogue lines */
 	FDialogueDB DialogueDataBase;
@@ -308,11 +621,66 @@ protected:
 	 *  broadcast delegates to name some of them... ) */
 	FDialogueLookupTable DialogueLookup;
 
-	/** Maps dialogue lines to categories, for quick category lookup */
-	TMap<FString, TMap<FString, TArray<UContextualDialogueLine*>>> Categories;
+	/** Interned categories and the posting lists of their lines, for quick category lookup */
+	FDialogueCategoryIndex CategoryIndex;
+
+	/**
+	 *	All the lines ever loaded, indexed by their DenseIndex. Deleted lines leave a nullptr behind. This is also what
+	 *	keeps the line objects from being garbage collected
+	 */
+	UPROPERTY()
+	TArray<UContextualDialogueLine*> DenseLines;
+
+	/** Advanced every time the database is (re)loaded or cleared, invalidates prepared queries */
+	uint32 DatabaseVersion = 1;
+
+	/** One bit per entry in DenseLines, set for lines still present in the database */
+	FDialogueBitSet LiveLines;
+
+	/** Inverted index of line parameters, used to resolve required/excluded parameters of a query */
+	FDialogueParameterIndex ParameterIndex;
+
+	/** Tracks which lines have to be re-evaluated after world variables change */
+	FDialogueDependencyGraph DependencyGraph;
+
+	/** Every distinct condition of the database, evaluated once per change of its variable and shared by all the lines */
+	FDialogueConditionTable ConditionTable;
+
+	/** Lines partitioned by their most selective critical equality condition, lets queries skip whole partitions */
+	FDialogueConditionPartitions Partitions;
+
+	/** Per-line cached scores, indexed by DenseIndex. Only valid for lines that are not dirty */
+	TArray<FDialogueLineCacheEntry> LineCache;
+
+	/** Per-line cached filter results, indexed by DenseIndex. Only valid for lines that are not dirty */
+	FDialogueBitSet FilterPassLines;
+
+	/**
+	 *	Working memory reused by every query. Mutable, since the const query stages use it as well. Queries are done
+	 *	with it before they process any line callbacks, so a callback is free to start another query
+	 */
+	mutable FDialogueQueryScratch QueryScratch;
 
 	/** Contains the objects currently reflected in the Dialogue System's world state */
+	FDialogueWorldStateStore WorldStore;
+
+	/** Immutable copy of WorldStore shared by the async queries, at the version it reports */
+	TSharedPtr<const FDialogueWorldStateStore, ESPMode::ThreadSafe> WorldStoreSnapshot;
+
+	/** Copy of WorldStore for the async queries, only taken again once the store has changed */
+	TSharedRef<const FDialogueWorldStateStore, ESPMode::ThreadSafe> GetWorldStoreSnapshot();
+
+	/** The World State as the Blueprint API and the listeners see it, rebuilt from WorldStore on demand */
 	TMap<FString, FObjectValueMapping> WorldState;
+
+	/** Version of WorldStore the view has last been rebuilt at */
+	uint64 WorldStateViewVersion = 0;
+
+	/** Re-export the objects that changed since the view has last been rebuilt */
+	void RefreshWorldStateView();
+
+	/** Send the current World State to its listeners */
+	void BroadcastWorldState();
 	
 	/**
 	 *	Register a dialogue context component with the subsystem and add its variables to the World State
@@ -320,6 +688,196 @@ protected:
 	 *	@param ContextComponent	The context component to process
 	 */
 	void AddDialogueComponentToWorldState(UDialogueContextComponent* ContextComponent);
+
+	/**
+	 *	Assign the next dense index to a line and register it with all the query indices
+	 *
+	 *	@param Line	The line that has just been added to the database
+	 */
+	void AddLineToIndices(UContextualDialogueLine* Line);
+
+	/** Resolve the variable and the string literal of a condition against WorldStore */
+	void BindCondition(FDialogueCondition& Condition);
+
+	/**
+	 *	Remove a line from all the query indices. Its dense index is not reused
+	 *
+	 *	@param Line	The line that has just been removed from the database
+	 */
+	void RemoveLineFromIndices(UContextualDialogueLine* Line);
+
+	/**
+	 *	Score all the candidate lines of a query. Cached lines are taken first, then the dirty lines are re-evaluated
+	 *	and stored in the line cache, most conditions first. Dirty lines whose best possible score can't beat the K-th
+	 *	score kept so far are skipped (and stay dirty). Large dirty sets are split into chunks scored on worker threads,
+	 *	each with its own top-K, which are merged at the end
+	 *
+	 *	@param[in]	Candidates	Lines that passed all the other query stages
+	 *	@param[out]	OutTopK		Receives the lines that passed their filters
+	 */
+	void ScoreCandidates(const FDialogueBitSet& Candidates, FDialogueTopKSelector& OutTopK);
+
+	/** Evaluate the distinct conditions whose variables changed since the last query */
+	void RefreshConditionTable();
+
+	/**
+	 *	Re-evaluate a single line, store the results in the line cache and clear its dirty bit. Only touches the line's
+	 *	own cache entry, filter bit and dirty bit, so lines from different FDialogueBitSet words can be refreshed
+	 *	concurrently
+	 *
+	 *	@param LineIdx		Dense index of the line
+	 *	@param Version		Dependency graph version the results are valid for
+	 *	@param Threshold	Top-K key the line has to beat (see FDialogueTopKSelector::GetThreshold()), 0 to always finish
+	 *	@return False if the evaluation was abandoned because the line can't beat the threshold, the line stays dirty
+	 */
+	bool RefreshLine(const int32 LineIdx, const uint64 Version, const uint64 Threshold);
+
+#if WITH_EDITOR
+	/**
+	 *	Capture the debug data of a finished query and broadcast it through OnDialogueQueryFinished. Does nothing (and
+	 *	allocates nothing) when no one is listening
+	 *
+	 *	@param ScoredLines	Lines that passed all the query stages and their filters
+	 */
+	void BroadcastQueryDebugCapture(const FDialogueBitSet& ScoredLines) const;
+#endif
+
+	/**
+	 *	Bring an object of the World State up to date with the live variables of a dialogue component. Values are
+	 *	compared in place in the actor's memory, only the variables that changed are written, and the lines depending on
+	 *	them are marked dirty
+	 *
+	 *	@param ObjectIdx		Index of the object in the World State store
+	 *	@param ContextComponent	Component whose owning actor holds the live values
+	 */
+	void SyncObjectMapping(const int32 ObjectIdx, UDialogueContextComponent* ContextComponent);
+
+	/**
+	 *	Write a variable into the World State, marking the lines reading it dirty if its value has changed
+	 *
+	 *	@param ObjectIdx	Index of the object in the World State store
+	 *	@param VarName		Name of the variable
+	 *	@param NewVal		New value of the variable
+	 */
+	void WriteIntVariable(const int32 ObjectIdx, const FString& VarName, const int NewVal);
+	void WriteFloatVariable(const int32 ObjectIdx, const FString& VarName, const double NewVal);
+	void WriteStrVariable(const int32 ObjectIdx, const FString& VarName, const FString& NewVal);
+	void WriteNameVariable(const int32 ObjectIdx, const FString& VarName, const FName NewVal);
+
+	/**
+	 *	Write a variable of an object that may be mapped to an actor, e.g. from a callback or a save. The actor is
+	 *	updated first, and the World State then stores what the actor has accepted - see
+	 *	UDialogueContextComponent::IsDialogueVarConstrained()
+	 *
+	 *	@param ObjectIdx	Index of the object in the World State store
+	 *	@param VarName		Name of the variable
+	 *	@param NewVal		New value of the variable
+	 */
+	void WriteMappedIntVariable(const int32 ObjectIdx, const FString& VarName, const int NewVal);
+	void WriteMappedFloatVariable(const int32 ObjectIdx, const FString& VarName, const double NewVal);
+	void WriteMappedStrVariable(const int32 ObjectIdx, const FString& VarName, const FString& NewVal);
+
+	/** Component of the actor an object is mapped to, nullptr for the World, the lines and streamed out actors */
+	UDialogueContextComponent* GetMappedComponent(const int32 ObjectIdx) const;
+
+	/** Set whenever a variable of the World State changes, cleared once the listeners have been told about it */
+	bool bWorldStateChanged = false;
+
+	/** Notify the World State listeners if anything changed since the last notification */
+	void BroadcastWorldStateChange();
+
+	/**
+	 *	Run the query stages that only depend on the database (parameters, categories) and return the lines that
+	 *	survive them
+	 *
+	 *	@param[in]	QueryCategories		Categories requested by the query
+	 *	@param[in]	CategoryMatch		How the requested categories combine
+	 *	@param[in]	RequiredParameters	Parameters the lines must have ('*' matches any value)
+	 *	@param[in]	ExcludedParameters	Parameters the lines must NOT have ('*' matches any value)
+	 *	@param[out]	OutCandidates		Set with one bit per line in DenseLines
+	 */
+	void BuildStaticCandidates(const TArray<FQueryCategory>& QueryCategories, const EDialogueCategoryMatch CategoryMatch,
+	                           const TMap<FString, FString>& RequiredParameters, const TMap<FString, FString>& ExcludedParameters,
+	                           FDialogueBitSet& OutCandidates) const;
+
+	/**
+	 *	Run the query stages that depend on the World State (partitions, cached filters)
+	 *
+	 *	@param[in,out]	Candidates		Lines that passed the other stages
+	 *	@param[in]		UnprunedLines	Optional lines to keep regardless, e.g. lines reading a variable the caller is
+	 *									going to override
+	 */
+	void ApplyWorldStages(FDialogueBitSet& Candidates, const FDialogueBitSet* UnprunedLines = nullptr) const;
+
+	/**
+	 *	Estimate the selectivity of every stage a query needs from the index statistics, and order them most
+	 *	selective first
+	 *
+	 *	@param[in]	QueryCategories		Categories requested by the query
+	 *	@param[in]	CategoryMatch		How the requested categories combine
+	 *	@param[in]	RequiredParameters	Parameters the lines must have ('*' matches any value)
+	 *	@param[in]	ExcludedParameters	Parameters the lines must NOT have ('*' matches any value)
+	 *	@param[in]	bStaticStages		Plan the stages depending on the database only (parameters, categories)
+	 *	@param[in]	bWorldStages		Plan the stages depending on the World State (partitions, cached filters)
+	 *	@param[out]	OutPlan				The plan
+	 */
+	void PlanQueryStages(const TArray<FQueryCategory>& QueryCategories, const EDialogueCategoryMatch CategoryMatch,
+	                     const TMap<FString, FString>& RequiredParameters, const TMap<FString, FString>& ExcludedParameters,
+	                     const bool bStaticStages, const bool bWorldStages, FDialogueQueryPlan& OutPlan) const;
+
+	/**
+	 *	Run the stages of a plan in order, each as a mask or as per-line probes, whichever is cheaper given the number
+	 *	of lines still surviving. Records the survivors of every stage into the plan
+	 *
+	 *	@param[in,out]	Plan				Plan to execute
+	 *	@param[in]		QueryCategories		Categories requested by the query
+	 *	@param[in]		CategoryMatch		How the requested categories combine
+	 *	@param[in]		RequiredParameters	Parameters the lines must have ('*' matches any value)
+	 *	@param[in]		ExcludedParameters	Parameters the lines must NOT have ('*' matches any value)
+	 *	@param[in,out]	InOutCandidates		Lines to narrow down
+	 *	@param[in]		UnprunedLines		Optional lines the World State stages must keep
+	 */
+	void ExecuteQueryPlan(FDialogueQueryPlan& Plan, const TArray<FQueryCategory>& QueryCategories,
+	                      const EDialogueCategoryMatch CategoryMatch, const TMap<FString, FString>& RequiredParameters,
+	                      const TMap<FString, FString>& ExcludedParameters, FDialogueBitSet& InOutCandidates,
+	                      const FDialogueBitSet* UnprunedLines = nullptr) const;
+
+	/**
+	 *	Score the candidates of a query, pick the best NoLines of them and process their callbacks if requested
+	 *
+	 *	@param[in]	Candidates			Lines that passed all the other query stages
+	 *	@param[in]	NoLines				How many lines should be returned
+	 *	@param[in]	ProcessCallbacks	Should callbacks of selected lines be processed immediately upon selection?
+	 *	@param[out]	OutLines			Holds lines returned by the query
+	 */
+	void RunCandidateQuery(FDialogueBitSet& Candidates, const int32 NoLines, bool ProcessCallbacks, TArray<UContextualDialogueLine*>& OutLines);
+
+	/**
+	 *	Score the candidates of a query and pick the best NoLines of them into QueryScratch.BestLineIndices, sorted the
+	 *	same way queries return their lines
+	 *
+	 *	@param Candidates	Lines that passed all the other query stages
+	 *	@param NoLines		How many lines should be picked
+	 */
+	void SelectBestLines(FDialogueBitSet& Candidates, const int32 NoLines);
+
+	/**
+	 *	Plan and run all the query stages (partitions, parameters, categories, cached filters) and return the lines
+	 *	that survive them
+	 *
+	 *	@param[in]	QueryCategories		Categories requested by the query
+	 *	@param[in]	CategoryMatch		How the requested categories combine
+	 *	@param[in]	RequiredParameters	Parameters the lines must have ('*' matches any value)
+	 *	@param[in]	ExcludedParameters	Parameters the lines must NOT have ('*' matches any value)
+	 *	@param[out]	OutCandidates		Set with one bit per line in DenseLines
+	 *	@param[in]	UnprunedLines		Optional lines the World State stages must keep, e.g. lines reading a variable the
+	 *									caller is going to override
+	 *	@param[out]	OutPlan				Optionally receives the executed plan
+	 */
+	void BuildCandidates(const TArray<FQueryCategory>& QueryCategories, const EDialogueCategoryMatch CategoryMatch,
+	                     const TMap<FString, FString>& RequiredParameters, const TMap<FString, FString>& ExcludedParameters,
+	                     FDialogueBitSet& OutCandidates, const FDialogueBitSet* UnprunedLines = nullptr,
+	                     FDialogueQueryPlan* OutPlan = nullptr) const;
 	
 	// TODO: A copy-paste. Should move to some global function library, but RN can't be bothered to figure out how to dynamically switch
 	// TODO: Between GetOwner() on components and *this on regular objects
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "GameplayTagContainer.h"
 #include "DialogueManagerUtils.generated.h"
 
 DECLARE_LOG_CATEGORY_EXTERN(DialogueManagerUtils, Log, All);
@@ -38,6 +39,20 @@ static const char *EConditionType_str[] =
 static const char *EConditionType_sign[] =
 	{ "=", "<", ">", "<=", ">=" };
 
+/**
+ *  Type of the literal a condition compares against. It is decided once, when the condition is compiled, so that
+ *  querying never has to inspect the raw ValueToCompare string again.
+ */
+enum class EDialogueLiteralType : uint8
+{
+	/** Whole numbers and the "true"/"false" literals, compared against integer, boolean and float variables */
+	Integer,
+	/** Numbers with a fractional part, compared against float and integer variables */
+	Float,
+	/** Anything else, compared for equality against string, name, enum and gameplay tag variables */
+	String
+};
+
 /**
  * Defines types of callbacks encountered in the Dialogue DB - we can assign (strings and integers) as well as
  * subtract and add (integers only)
@@ -85,6 +100,20 @@ inline bool operator==(const FDialogueCallback& lhs, const FDialogueCallback& rh
 			lhs.Parameter == rhs.Parameter;
 }
 
+/**
+ *	Location of a variable in the World State store - the index of its object and its slot in every value lane.
+ *	Resolved once, so that reading the variable never hashes its name again
+ */
+struct FDialogueVariableRef
+{
+	int32 ObjectIdx = INDEX_NONE;
+	int32 IntSlot = INDEX_NONE;
+	int32 FloatSlot = INDEX_NONE;
+	int32 StrSlot = INDEX_NONE;
+
+	FORCEINLINE bool IsValid() const { return ObjectIdx != INDEX_NONE; }
+};
+
 /**
  *  Contains a single dialogue condition within FDialogueLine. Conditions need to know which variable to check and
  *  what comparison type is to be executed
@@ -107,10 +136,108 @@ struct FDialogueCondition
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	bool IsCritical = false;
 	
-	/** Utility variable, used only in Editor, to highlight matched queries in the debug widget */
+	/**
+	 *	Utility variable, used only in Editor, to highlight matched queries in the debug widget. Queries never write it,
+	 *	the debug widget copies it over from FDialogueLineMatchCapture
+	 */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	bool IsMatched = false;
 
+	/** Object part of VariableToCheck (e.g. "World" for "World.Speaker"). Set by Compile() */
+	FString ObjectId;
+
+	/** Variable part of VariableToCheck (e.g. "Speaker" for "World.Speaker"). Set by Compile() */
+	FString VariableId;
+
+	/** Whether ValueToCompare should be compared against integer or string variables. Set by Compile() */
+	EDialogueLiteralType LiteralType = EDialogueLiteralType::String;
+
+	/** ValueToCompare parsed into an integer, only meaningful for EDialogueLiteralType::Integer. Set by Compile() */
+	int32 IntValue = 0;
+
+	/** ValueToCompare parsed into a number, meaningful for both EDialogueLiteralType::Integer and Float. Set by Compile() */
+	double NumberValue = 0.0;
+
+	/** False if VariableToCheck could not be split into an object and a variable - such condition is never fulfilled */
+	bool IsValidReference = false;
+
+	/**
+	 *	Where VariableToCheck lives in the World State store. Bound when the owning line is added to the database,
+	 *	reset by Compile()
+	 */
+	FDialogueVariableRef VariableRef;
+
+	/**
+	 *	ValueToCompare interned into the string ids of the World State store, only for EDialogueLiteralType::String.
+	 *	Ids compare case-insensitively, like the strings they replace. Bound with VariableRef, reset by Compile()
+	 */
+	int32 LiteralStrId = INDEX_NONE;
+
+	/**
+	 *	Id of this condition in the subsystem's FDialogueConditionTable, shared by all the identical conditions in the
+	 *	database. Assigned when the owning line is added to the database, INDEX_NONE for invalid references
+	 */
+	int32 TableId = INDEX_NONE;
+
+	/**
+	 *	Resolves VariableToCheck and ValueToCompare into the compiled fields above. Has to be called again whenever
+	 *	either of them is modified, otherwise queries will keep using the old values.
+	 *
+	 *	@return True if the condition references a valid "Object.Variable" pair, False otherwise
+	 */
+	bool Compile();
+
+	/**
+	 *	Compare an integer world state value against this condition's compiled integer literal
+	 *
+	 *	@param VarValue	Current value of the variable referenced by the condition
+	 *	@return True if the comparison holds
+	 */
+	FORCEINLINE bool CompareInt(const int32 VarValue) const
+	{
+		switch (ConditionType)
+		{
+		case EQUAL:
+			return VarValue == IntValue;
+		case GT:
+			return VarValue > IntValue;
+		case LT:
+			return VarValue < IntValue;
+		case GET:
+			return VarValue >= IntValue;
+		case LET:
+			return VarValue <= IntValue;
+		default:
+			return false;
+		}
+	}
+
+	/**
+	 *	Compare a float (or an integer against a fractional literal) world state value against this condition's
+	 *	compiled numeric literal
+	 *
+	 *	@param VarValue	Current value of the variable referenced by the condition
+	 *	@return True if the comparison holds
+	 */
+	FORCEINLINE bool CompareNumber(const double VarValue) const
+	{
+		switch (ConditionType)
+		{
+		case EQUAL:
+			return VarValue == NumberValue;
+		case GT:
+			return VarValue > NumberValue;
+		case LT:
+			return VarValue < NumberValue;
+		case GET:
+			return VarValue >= NumberValue;
+		case LET:
+			return VarValue <= NumberValue;
+		default:
+			return false;
+		}
+	}
+
 	/** Get condition value as string*/
 	FString ConditionValueAsString() const;
 	
@@ -125,6 +252,36 @@ inline bool operator==(const FDialogueCondition& lhs, const FDialogueCondition&
 			lhs.IsCritical == rhs.IsCritical;
 }
 
+/**
+ *	Debug-only record of which conditions and filters of a single line were fulfilled when a query scored it. Captured
+ *	into a side buffer, so that evaluating conditions never has to write into the shared line objects.
+ */
+USTRUCT(BlueprintType)
+struct FDialogueLineMatchCapture
+{
+	GENERATED_BODY()
+
+	/** One entry per UContextualDialogueLine::Conditions */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	TArray<bool> ConditionsMatched;
+
+	/** One entry per UContextualDialogueLine::Filters */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	TArray<bool> FiltersMatched;
+};
+
+/**
+ *	How the categories of a query combine when more than one is requested
+ */
+UENUM(BlueprintType)
+enum class EDialogueCategoryMatch : uint8
+{
+	/** Lines belonging to at least one of the requested categories */
+	AnyOf,
+	/** Lines belonging to every requested category */
+	AllOf
+};
+
 /**
  * Represents a single query category. Categories split the database into subsets for easier lookup.
  */
@@ -138,6 +295,13 @@ struct FQueryCategory
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	FString CategoryValue;
+
+	/**
+	 *	When valid, the category is matched by this tag instead of by its name and value. Tags match hierarchically, so
+	 *	Bark.Combat also matches the lines tagged Bark.Combat.Reload
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	FGameplayTag CategoryTag;
 };
 
 /**
@@ -171,6 +335,16 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	TArray<FDialogueCondition> Filters;
 
+	/** Categories of this line as gameplay tags, queried hierarchically (see FQueryCategory::CategoryTag) */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	FGameplayTagContainer CategoryTags;
+
+	/**
+	 *	Position of this line in the subsystem's dense line index, assigned when the line is added to the database.
+	 *	Query stages address lines by this index (one bit per line), it is never reused until the database is reloaded.
+	 */
+	int32 DenseIndex = INDEX_NONE;
+
 	/**
 	 *	Get value of a parameter
 	 *
@@ -258,6 +432,10 @@ struct FObjectValueMapping
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	TMap<FString, int> IntVals;
 
+	/** Map of all the float variables. Maps variable name -> float value */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	TMap<FString, double> FloatVals;
+
 	/** Array of all the DSS callbacks. Callbacks always take a Map<FString, FString> as the only parameter. */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	TArray<FString> CallbackNames;
@@ -328,50 +506,46 @@ inline bool operator<(const FLineScore& lhs, const FLineScore& rhs)
 }
 
 /**
- *	A structure that keeps track of scores of multiple lines. The maximum amount of lines to hold is specified upon
- *	creating. It holds info about its current Min and Max scores. It is also capable of returning N best scores out
- *	of the currently held lines.
+ *	A single query of a batch, see UDialogueManagerSubsystem::GetLinesForSpeakers()
  */
-USTRUCT()
-struct FMultipleLineScoring
+USTRUCT(BlueprintType)
+struct FDialogueQueryDescriptor
 {
 	GENERATED_BODY()
 
-	FMultipleLineScoring() : FMultipleLineScoring(10) {};
-	FMultipleLineScoring(int NoLines) : NoLines(NoLines), CurrLines(0), CurrMaxScore(nullptr), CurrMinScore(nullptr), CurrMaxIdx(0), CurrMinIdx(0) {};
+	/** Value "World.Speaker" takes while this query is evaluated */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	FString Speaker;
 
-	/** The maximum amount of lines to hold in this structure */
-	int NoLines;
+	/** How many lines should be returned */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	int32 NoLines = 1;
 
-	/** Number of lines currently held*/
-	int CurrLines;
+	/** Categories to pass to the query (lines without matching categories won't even be considered) */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	TArray<FQueryCategory> QueryCategories;
 
-	/** Pointers to LineScore structures that are the current minimum and maximum */
-	FLineScore *CurrMaxScore, *CurrMinScore;
+	/** Whether the lines have to belong to any or to all of the QueryCategories */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	EDialogueCategoryMatch CategoryMatch = EDialogueCategoryMatch::AnyOf;
 
-	/** Indices at which the current Minimum and Maximum are kept in the Lines TArray*/
-	int CurrMaxIdx, CurrMinIdx;
+	/** Parameters (key-value) the lines must have ('*' matches any value) */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	TMap<FString, FString> RequiredParameters;
 
-	/** Currently kept lines and scores. The assumption is that Scores and Lines are kept in relative order */
-	TArray<FLineScore> Scores;
-	TArray<UContextualDialogueLine*> Lines;
+	/** Parameters (key-value) the lines must NOT have ('*' matches any value) */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	TMap<FString, FString> ExcludedParameters;
+};
 
-	/**
-	 *	Evaluate and add a line
-	 *
-	 *	@param Line		Dialogue line to be checked
-	 *	@param Score	Score of the line
-	 *
-	 *	@return True if successfully added, False otherwise
-	 */
-	bool CheckAndAddLine(UContextualDialogueLine* Line, FLineScore Score);
+/**
+ *	Lines returned for a single query of a batch, in the same order GetLinesForCurrentContext() would return them
+ */
+USTRUCT(BlueprintType)
+struct FDialogueQueryResult
+{
+	GENERATED_BODY()
 
-	/**
-	 *	Return N best lines from the current state.  The amount of lines returned can be actually different than requested N
-	 *	e.g. in the case where less lines are kept in the structure than were requested
-	 *
-	 *	@param[in]	NoOfElements	How many elements to return
-	 *	@param[out] OutLines		TArray to hold the returned N best lines
-	 */
-	void GetNBestResults(const int NoOfElements, TArray<UContextualDialogueLine*>& OutLines);
-};
\ No newline at end of file
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	TArray<UContextualDialogueLine*> Lines;
+};
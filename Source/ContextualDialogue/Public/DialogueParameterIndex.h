@@ -0,0 +1,103 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DialogueBitSet.h"
+#include "DialoguePostingList.h"
+
+class UContextualDialogueLine;
+
+/**
+ *	Inverted index over the Parameters of dialogue lines. For every parameter key it keeps the lines that have that key,
+ *	and for every key-value pair the lines that have exactly that value. Required and excluded parameter constraints of
+ *	a query are then resolved by intersecting and subtracting posting lists, instead of looking into every single line.
+ */
+class CONTEXTUALDIALOGUE_API FDialogueParameterIndex
+{
+public:
+	/** Wildcard parameter value, matches a key regardless of its value */
+	static const FString Wildcard;
+
+	/** Drop all the posting lists */
+	void Reset();
+
+	/**
+	 *	Add all the parameters of a line to the index. The line has to have its DenseIndex assigned already
+	 *
+	 *	@param Line	Line to index
+	 */
+	void AddLine(const UContextualDialogueLine* Line);
+
+	/**
+	 *	Remove all the parameters of a line from the index
+	 *
+	 *	@param Line	Line to remove
+	 */
+	void RemoveLine(const UContextualDialogueLine* Line);
+
+	/**
+	 *	Get the posting list of a single constraint
+	 *
+	 *	@param Key		Parameter key
+	 *	@param Value	Parameter value, or Wildcard for any value
+	 *	@return Lines matching the constraint, nullptr if there are none
+	 */
+	const FDialoguePostingList* Find(const FString& Key, const FString& Value) const;
+
+	/**
+	 *	Estimate how many lines satisfy the constraints, from the posting list lengths only
+	 *
+	 *	@param RequiredParameters	Parameters the lines must have ('*' matches any value)
+	 *	@param ExcludedParameters	Parameters the lines must NOT have ('*' matches any value)
+	 *	@param NumLines				Number of lines in the database
+	 *	@param OutListCost			Total length of the posting lists involved, i.e. the cost of resolving the constraints
+	 *	@return Upper bound of the matching lines
+	 */
+	int32 Estimate(const TMap<FString, FString>& RequiredParameters, const TMap<FString, FString>& ExcludedParameters,
+	               const int32 NumLines, int32& OutListCost) const;
+
+	/**
+	 *	Check the constraints against a single line, without touching the index
+	 *
+	 *	@param Line					Line to check
+	 *	@param RequiredParameters	Parameters the line must have ('*' matches any value)
+	 *	@param ExcludedParameters	Parameters the line must NOT have ('*' matches any value)
+	 *	@return True if the line satisfies all the constraints
+	 */
+	static bool Matches(const UContextualDialogueLine* Line, const TMap<FString, FString>& RequiredParameters,
+	                    const TMap<FString, FString>& ExcludedParameters);
+
+	/**
+	 *	Resolve required and excluded parameter constraints into a line mask
+	 *
+	 *	@param[in]	RequiredParameters	Parameters the lines must have ('*' matches any value)
+	 *	@param[in]	ExcludedParameters	Parameters the lines must NOT have ('*' matches any value)
+	 *	@param[in]	NumLines			Size of the dense line index
+	 *	@param[out]	OutMask				Set with one bit per line that meets all the constraints
+	 */
+	void BuildMask(const TMap<FString, FString>& RequiredParameters, const TMap<FString, FString>& ExcludedParameters,
+	               const int32 NumLines, FDialogueBitSet& OutMask) const;
+
+	/**
+	 *	Resolve required and excluded parameter constraints into a posting list
+	 *
+	 *	@param[in]	RequiredParameters	Parameters the lines must have ('*' matches any value). Must not be empty
+	 *	@param[in]	ExcludedParameters	Parameters the lines must NOT have ('*' matches any value)
+	 *	@param[out]	OutLines			Sorted dense indices of the lines that meet all the constraints
+	 */
+	void Resolve(const TMap<FString, FString>& RequiredParameters, const TMap<FString, FString>& ExcludedParameters,
+	             FDialoguePostingList& OutLines) const;
+
+private:
+	/** Parameter key -> lines having that key, with any value */
+	TMap<FString, FDialoguePostingList> KeyPostings;
+
+	/** Parameter key -> parameter value -> lines having that exact key-value pair */
+	TMap<FString, TMap<FString, FDialoguePostingList>> KeyValuePostings;
+
+	/**
+	 *	Intermediate lists of Resolve() and BuildMask(), kept around so that resolving constraints doesn't allocate once
+	 *	they have grown large enough. The index is only ever queried from the game thread
+	 */
+	mutable FDialoguePostingList ResolveScratch;
+	mutable FDialoguePostingList MaskScratch;
+};
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Algo/BinarySearch.h"
+
+/** A sorted (ascending) list of dense line indices, the building block of all the dialogue database indices */
+typedef TArray<int32> FDialoguePostingList;
+
+/**
+ *	Linear-time set operations over sorted posting lists. All the functions expect their inputs sorted and without
+ *	duplicates, and keep their outputs that way.
+ */
+class FDialoguePostingListUtils
+{
+public:
+	/**
+	 *	Insert a line index, keeping the list sorted. Appending in ascending order (the loading case) is O(1)
+	 *
+	 *	@param List			List to insert into
+	 *	@param LineIndex	Dense index to insert
+	 */
+	static void Insert(FDialoguePostingList& List, const int32 LineIndex)
+	{
+		if (List.Num() == 0 || List.Last() < LineIndex)
+		{
+			List.Add(LineIndex);
+			return;
+		}
+
+		const int32 Pos = Algo::LowerBound(List, LineIndex);
+		if (List[Pos] != LineIndex)
+			List.Insert(LineIndex, Pos);
+	}
+
+	/**
+	 *	Remove a line index from the list, if present
+	 *
+	 *	@param List			List to remove from
+	 *	@param LineIndex	Dense index to remove
+	 *	@return True if the index was found and removed
+	 */
+	static bool Remove(FDialoguePostingList& List, const int32 LineIndex)
+	{
+		const int32 Pos = Algo::BinarySearch(List, LineIndex);
+		if (Pos == INDEX_NONE)
+			return false;
+
+		List.RemoveAt(Pos);
+		return true;
+	}
+
+	/** Out = A & B */
+	static void Intersect(const FDialoguePostingList& A, const FDialoguePostingList& B, FDialoguePostingList& Out)
+	{
+		Out.Reset();
+		int32 i = 0, j = 0;
+		while (i < A.Num() && j < B.Num())
+		{
+			if (A[i] < B[j])
+				i++;
+			else if (B[j] < A[i])
+				j++;
+			else
+			{
+				Out.Add(A[i]);
+				i++;
+				j++;
+			}
+		}
+	}
+
+	/** Out = A | B */
+	static void Union(const FDialoguePostingList& A, const FDialoguePostingList& B, FDialoguePostingList& Out)
+	{
+		Out.Reset();
+		Out.Reserve(A.Num() + B.Num());
+		int32 i = 0, j = 0;
+		while (i < A.Num() && j < B.Num())
+		{
+			if (A[i] < B[j])
+				Out.Add(A[i++]);
+			else if (B[j] < A[i])
+				Out.Add(B[j++]);
+			else
+			{
+				Out.Add(A[i]);
+				i++;
+				j++;
+			}
+		}
+		while (i < A.Num())
+			Out.Add(A[i++]);
+		while (j < B.Num())
+			Out.Add(B[j++]);
+	}
+
+	/** Out = A & ~B */
+	static void Subtract(const FDialoguePostingList& A, const FDialoguePostingList& B, FDialoguePostingList& Out)
+	{
+		Out.Reset();
+		int32 i = 0, j = 0;
+		while (i < A.Num())
+		{
+			if (j >= B.Num() || A[i] < B[j])
+				Out.Add(A[i++]);
+			else if (B[j] < A[i])
+				j++;
+			else
+			{
+				i++;
+				j++;
+			}
+		}
+	}
+};
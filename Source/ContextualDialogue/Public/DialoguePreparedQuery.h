@@ -0,0 +1,35 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DialogueBitSet.h"
+#include "DialogueManagerUtils.h"
+#include "DialoguePreparedQuery.generated.h"
+
+/**
+ *	A query whose categories and parameters have been resolved against the dialogue database once, see
+ *	UDialogueManagerSubsystem::PrepareQuery(). Executing it only polls the World State and scores the lines that
+ *	passed those stages, there is no setup left to do.
+ *
+ *	The handle is tied to the database it was prepared against - lines deleted since then are simply skipped, but
+ *	reloading the database invalidates it. An invalidated query is prepared again on its next execution.
+ */
+USTRUCT(BlueprintType)
+struct FDialoguePreparedQuery
+{
+	GENERATED_BODY()
+
+	/** How many lines the query returns */
+	int32 NoLines = 0;
+
+	/** Inputs the query was prepared from, kept to prepare it again after the database is reloaded */
+	TArray<FQueryCategory> QueryCategories;
+	EDialogueCategoryMatch CategoryMatch = EDialogueCategoryMatch::AnyOf;
+	TMap<FString, FString> RequiredParameters;
+	TMap<FString, FString> ExcludedParameters;
+
+	/** Lines passing the category and parameter stages, one bit per dense line index */
+	FDialogueBitSet Candidates;
+
+	/** UDialogueManagerSubsystem::DatabaseVersion the query was prepared against, 0 if never prepared */
+	uint32 DatabaseVersion = 0;
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+/** Stages narrowing down the candidate lines of a query before anything gets scored */
+enum class EDialogueQueryStage : uint8
+{
+	/** Lines whose partition key matches the current World State (see FDialogueConditionPartitions) */
+	Partitions,
+	/** Lines having the required parameters and none of the excluded ones */
+	Parameters,
+	/** Lines belonging to any (or all, see EDialogueCategoryMatch) of the requested categories */
+	Categories,
+	/** Lines whose cached filters passed (dirty lines are kept, their filters are checked when scoring) */
+	Filters
+};
+
+/** How a stage is applied to the lines that survived the stages before it */
+enum class EDialogueStageMode : uint8
+{
+	/** Build the stage's line mask from its index and AND it in - cost follows the index and the database size */
+	Mask,
+	/** Check every surviving line on its own - cost follows the number of survivors */
+	Probe
+};
+
+/** A single stage of a query plan */
+struct FDialogueQueryPlanStage
+{
+	EDialogueQueryStage Stage;
+	EDialogueStageMode Mode = EDialogueStageMode::Mask;
+
+	/** Lines the stage is expected to let through on its own, estimated from the index statistics */
+	int32 EstimatedLines = 0;
+
+	/** Estimated cost of building the stage's mask, and of probing a single line */
+	int32 MaskCost = 0;
+	int32 ProbeCostPerLine = MAX_int32;
+
+	/** Candidates left after the stage has run, INDEX_NONE until then */
+	int32 SurvivingLines = INDEX_NONE;
+};
+
+/**
+ *	Order in which the stages of a query run. The most selective stage (the fewest estimated lines) runs first, so the
+ *	later ones only have to deal with its survivors - each of them is then either applied as a mask or probed line by
+ *	line, whichever is cheaper at that point.
+ */
+struct FDialogueQueryPlan
+{
+	/** Stages in execution order */
+	TArray<FDialogueQueryPlanStage, TInlineAllocator<4>> Stages;
+
+	/** Candidates before the first stage */
+	int32 InitialLines = 0;
+
+	/** Human readable description of the plan and of the per-stage cardinalities, for logs and debugging */
+	FString ToString() const
+	{
+		static const TCHAR* StageNames[] = { TEXT("Partitions"), TEXT("Parameters"), TEXT("Categories"), TEXT("Filters") };
+
+		FString Result = FString::Printf(TEXT("Live lines: %i"), InitialLines);
+		for (const FDialogueQueryPlanStage& Stage : Stages)
+		{
+			const FString Surviving = Stage.SurvivingLines == INDEX_NONE ? TEXT("?") : FString::FromInt(Stage.SurvivingLines);
+			Result += FString::Printf(TEXT(" -> %s (%s, estimated %i) = %s"), StageNames[static_cast<uint8>(Stage.Stage)],
+			                          Stage.Mode == EDialogueStageMode::Mask ? TEXT("mask") : TEXT("probe"),
+			                          Stage.EstimatedLines, *Surviving);
+		}
+		return Result;
+	}
+};
@@ -0,0 +1,209 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DialogueManagerUtils.h"
+
+/**
+ *	Keeps the K best scored lines of a query. Every line is packed into a single 64-bit key, ordered the same way as
+ *	FLineScore's operator> (score first, number of conditions second), with ties going to the line that was added to
+ *	the database first:
+ *
+ *		[63..32] Score as float bits (scores are never negative, so the bits order like the floats)
+ *		[31..20] NumQueries, clamped to 4095
+ *		[19..0]  MaxLineIndex - DenseIndex
+ *
+ *	The keys live in a bounded min-heap, so adding a line is O(log K) and the results are sorted once at the end.
+ *	K == 1 (GetBestLine) skips the heap altogether and just keeps a running maximum.
+ */
+class FDialogueTopKSelector
+{
+public:
+	/** Largest dense line index that fits into a key */
+	static constexpr int32 MaxLineIndex = (1 << 20) - 1;
+
+	/** Largest number of conditions that is still told apart when comparing keys */
+	static constexpr int32 MaxNumQueries = (1 << 12) - 1;
+
+	/**
+	 *	@param InK				How many lines to keep
+	 *	@param CandidateHint	How many lines are expected to be added at most, used to avoid over-allocating for huge K
+	 */
+	explicit FDialogueTopKSelector(const int32 InK, const int32 CandidateHint = MAX_int32)
+		: K(0), Best(0)
+	{
+		Reset(InK, CandidateHint);
+	}
+
+	/** Empty selector keeping no lines, Reset() it before use */
+	FDialogueTopKSelector()
+		: K(0), Best(0)
+	{
+	}
+
+	/**
+	 *	Forget every kept line and start a new selection. The heap keeps its allocation, so a selector that is reused
+	 *	across queries stops allocating once it has seen the largest K
+	 *
+	 *	@param InK				How many lines to keep
+	 *	@param CandidateHint	How many lines are expected to be added at most, used to avoid over-allocating for huge K
+	 */
+	void Reset(const int32 InK, const int32 CandidateHint = MAX_int32)
+	{
+		K = FMath::Max(InK, 0);
+		Best = 0;
+		Heap.Reset();
+		if (K > 1)
+			Heap.Reserve(FMath::Min(K, CandidateHint));
+	}
+
+	/** Pack a score and a line into a comparable key */
+	static FORCEINLINE uint64 PackKey(const FLineScore& Score, const int32 LineIndex)
+	{
+		checkSlow(LineIndex >= 0 && LineIndex <= MaxLineIndex);
+		uint32 ScoreBits;
+		FMemory::Memcpy(&ScoreBits, &Score.Score, sizeof(uint32));
+		const uint64 NumQueries = static_cast<uint64>(FMath::Clamp(Score.NumQueries, 0, MaxNumQueries));
+		return (static_cast<uint64>(ScoreBits) << 32) | (NumQueries << 20) | static_cast<uint64>(MaxLineIndex - LineIndex);
+	}
+
+	/** Get the dense line index back from a key */
+	static FORCEINLINE int32 UnpackLineIndex(const uint64 Key)
+	{
+		return MaxLineIndex - static_cast<int32>(Key & MaxLineIndex);
+	}
+
+	/**
+	 *	Consider a line. Lines scoring 0 are never returned by a query, so they are not even considered
+	 *
+	 *	@param Score		Score of the line
+	 *	@param LineIndex	Dense index of the line
+	 */
+	FORCEINLINE void Add(const FLineScore& Score, const int32 LineIndex)
+	{
+		if (Score.Score > 0.0f)
+			AddKey(PackKey(Score, LineIndex));
+	}
+
+	/** Consider an already packed key */
+	FORCEINLINE void AddKey(const uint64 Key)
+	{
+		if (K == 1)
+		{
+			Best = FMath::Max(Best, Key);
+		}
+		else if (Heap.Num() < K)
+		{
+			Heap.Add(Key);
+			SiftUp(Heap.Num() - 1);
+		}
+		else if (K > 0 && Key > Heap[0])
+		{
+			Heap[0] = Key;
+			SiftDown(0);
+		}
+	}
+
+	/** Fold the lines kept by another selector into this one */
+	void Merge(const FDialogueTopKSelector& Other)
+	{
+		if (Other.K == 1)
+		{
+			if (Other.Best != 0)
+				AddKey(Other.Best);
+			return;
+		}
+
+		for (const uint64 Key : Other.Heap)
+			AddKey(Key);
+	}
+
+	/**
+	 *	Key a line has to beat to still make it in. 0 while the selector isn't full, since then any line scoring above
+	 *	0 gets in
+	 */
+	FORCEINLINE uint64 GetThreshold() const
+	{
+		if (K == 0)
+			return MAX_uint64;
+		if (K == 1)
+			return Best;
+		return Heap.Num() < K ? 0 : Heap[0];
+	}
+
+	/** Maximum amount of lines kept */
+	FORCEINLINE int32 GetK() const { return K; }
+
+	/** Number of lines currently kept */
+	FORCEINLINE int32 Num() const { return K == 1 ? (Best != 0 ? 1 : 0) : Heap.Num(); }
+
+	/**
+	 *	Get the kept lines, in ascending order of their scores (the same order queries have always returned them in).
+	 *	The heap is sorted in place to avoid a copy, so the selector has to be Reset() before adding more lines
+	 *
+	 *	@param[out] OutLineIndices	Dense indices of the kept lines
+	 */
+	void GetSortedLineIndices(TArray<int32>& OutLineIndices)
+	{
+		OutLineIndices.Reset();
+
+		if (K == 1)
+		{
+			if (Best != 0)
+				OutLineIndices.Add(UnpackLineIndex(Best));
+			return;
+		}
+
+		Heap.Sort();
+
+		OutLineIndices.Reserve(Heap.Num());
+		for (const uint64 Key : Heap)
+			OutLineIndices.Add(UnpackLineIndex(Key));
+	}
+
+private:
+	/** Maximum amount of lines to keep */
+	int32 K;
+
+	/** Running maximum, used instead of the heap when K == 1 */
+	uint64 Best;
+
+	/** Min-heap of the kept keys, Heap[0] is the worst line currently kept */
+	TArray<uint64> Heap;
+
+	FORCEINLINE void SiftUp(int32 Index)
+	{
+		const uint64 Key = Heap[Index];
+		while (Index > 0)
+		{
+			const int32 Parent = (Index - 1) >> 1;
+			if (Heap[Parent] <= Key)
+				break;
+
+			Heap[Index] = Heap[Parent];
+			Index = Parent;
+		}
+		Heap[Index] = Key;
+	}
+
+	FORCEINLINE void SiftDown(int32 Index)
+	{
+		const int32 Count = Heap.Num();
+		const uint64 Key = Heap[Index];
+		while (true)
+		{
+			int32 Child = Index * 2 + 1;
+			if (Child >= Count)
+				break;
+
+			if (Child + 1 < Count && Heap[Child + 1] < Heap[Child])
+				Child++;
+
+			if (Key <= Heap[Child])
+				break;
+
+			Heap[Index] = Heap[Child];
+			Index = Child;
+		}
+		Heap[Index] = Key;
+	}
+};
@@ -0,0 +1,270 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DialogueBitSet.h"
+#include "DialogueManagerUtils.h"
+
+/**
+ *	Flat store of the World State. Object names and the names of their variables are interned into integer slots once,
+ *	and the values live in contiguous typed arrays indexed by those slots. Slots are never reused until Reset(), so a
+ *	consumer can look a variable up once and keep reading it by its slot.
+ *
+ *	There are three lanes: integers (booleans included, as 0 and 1), floats and strings. Names, enums and gameplay
+ *	tags are stored as strings. Every string value also gets an id from a table local to the store, shared with the
+ *	string literals of the conditions - string equality is then a comparison of two ids. Like FString's operator==,
+ *	the ids ignore case. Ids of values are released once no variable holds them anymore, so the table doesn't grow
+ *	with every string ever written, and nothing ends up in the global FName pool.
+ *
+ *	Every write that actually changes something advances a global version and stamps it on the slot and on its object.
+ *	That is what the FObjectValueMapping view of the Blueprint API is rebuilt from - only the objects stamped after the
+ *	last rebuild are exported again.
+ */
+class CONTEXTUALDIALOGUE_API FDialogueWorldStateStore
+{
+public:
+	/** An object of the World State - the actor of a dialogue component, the "World", or a line keeping its own variables */
+	struct FStoreObject
+	{
+		FString Name;
+
+		/** Should the variables of this object be updated on an Actor object during gameplay */
+		bool IsMappedToActor = false;
+
+		/** Reference to the underlying object */
+		UObject* ContextRef = nullptr;
+
+		/** False while the object is only reserved by BindVariable(), i.e. it isn't part of the World State yet */
+		bool IsLive = false;
+
+		/** All the DSS callbacks of the underlying object */
+		TArray<FString> CallbackNames;
+
+		/** Variable name -> slot of its value */
+		TMap<FString, int32> IntSlots;
+		TMap<FString, int32> FloatSlots;
+		TMap<FString, int32> StrSlots;
+
+		/** Version at which anything about the object has last changed */
+		uint64 Version = 0;
+	};
+
+	/** Drop all the objects and their variables. Versions keep counting up */
+	void Reset();
+
+	/** Index of an object, INDEX_NONE if it doesn't exist (or is only reserved) */
+	int32 FindObject(const FString& ObjectName) const;
+
+	/** Index of an object, adding it (with no variables) if it doesn't exist */
+	int32 FindOrAddObject(const FString& ObjectName);
+
+	/** Whether an object is part of the World State, rather than only reserved by BindVariable() */
+	FORCEINLINE bool IsObjectLive(const int32 ObjectIdx) const { return Objects[ObjectIdx].IsLive; }
+
+	/**
+	 *	Resolve a variable into its object and slots once, so that it can then be read by slot. Whatever doesn't exist
+	 *	yet is reserved: the object stays out of the World State until FindOrAddObject(), the slots hold no value
+	 *	until they are written
+	 *
+	 *	@param ObjectName	Name of the object owning the variable
+	 *	@param VarName		Name of the variable
+	 *	@return Reference valid until Reset()
+	 */
+	FDialogueVariableRef BindVariable(const FString& ObjectName, const FString& VarName);
+
+	/** Resolve a variable without reserving anything, whatever doesn't exist is INDEX_NONE */
+	FDialogueVariableRef FindVariable(const FString& ObjectName, const FString& VarName) const;
+
+	FORCEINLINE FStoreObject& GetObject(const int32 ObjectIdx) { return Objects[ObjectIdx]; }
+	FORCEINLINE const FStoreObject& GetObject(const int32 ObjectIdx) const { return Objects[ObjectIdx]; }
+	FORCEINLINE int32 NumObjects() const { return Objects.Num(); }
+
+	/** Stamp an object whose mapping to an actor or callbacks have changed, so that the view picks it up */
+	void TouchObject(const int32 ObjectIdx);
+
+	/** Slot of a variable, INDEX_NONE if it has never been written */
+	int32 FindIntSlot(const int32 ObjectIdx, const FString& VarName) const;
+	int32 FindFloatSlot(const int32 ObjectIdx, const FString& VarName) const;
+	int32 FindStrSlot(const int32 ObjectIdx, const FString& VarName) const;
+
+	/** Current value of a slot, nullptr if the variable has been removed */
+	FORCEINLINE const int32* ReadInt(const int32 Slot) const { return IntPresent.Test(Slot) ? &IntValues[Slot] : nullptr; }
+	FORCEINLINE const double* ReadFloat(const int32 Slot) const { return FloatPresent.Test(Slot) ? &FloatValues[Slot] : nullptr; }
+	FORCEINLINE const FString* ReadStr(const int32 Slot) const { return StrPresent.Test(Slot) ? &StrValues[Slot] : nullptr; }
+
+	/** Id of the value of a string slot, EmptyStrId if the variable has been removed (or is empty) */
+	FORCEINLINE int32 ReadStrId(const int32 Slot) const { return StrPresent.Test(Slot) ? StrIds[Slot] : EmptyStrId; }
+
+	/** Current value of a resolved variable, nullptr (EmptyStrId for ids) if it has no value in that lane */
+	FORCEINLINE const int32* ReadInt(const FDialogueVariableRef& Ref) const { return Ref.IntSlot != INDEX_NONE ? ReadInt(Ref.IntSlot) : nullptr; }
+	FORCEINLINE const double* ReadFloat(const FDialogueVariableRef& Ref) const { return Ref.FloatSlot != INDEX_NONE ? ReadFloat(Ref.FloatSlot) : nullptr; }
+	FORCEINLINE const FString* ReadStr(const FDialogueVariableRef& Ref) const { return Ref.StrSlot != INDEX_NONE ? ReadStr(Ref.StrSlot) : nullptr; }
+	FORCEINLINE int32 ReadStrId(const FDialogueVariableRef& Ref) const { return Ref.StrSlot != INDEX_NONE ? ReadStrId(Ref.StrSlot) : EmptyStrId; }
+
+	/** Id of the empty string, which is what missing string variables read as */
+	static constexpr int32 EmptyStrId = 0;
+
+	/**
+	 *	Id of a string literal, interning it if it is new. Literal ids are kept until Reset(), so that they can be
+	 *	resolved once and compared against ReadStrId() from then on
+	 *
+	 *	@param Value	Literal, compared ignoring case
+	 *	@return Id valid until Reset()
+	 */
+	int32 InternStrLiteral(const FString& Value);
+
+	/** Current value of a variable of a known object, nullptr if the variable doesn't exist */
+	const int32* FindInt(const int32 ObjectIdx, const FString& VarName) const;
+	const double* FindFloat(const int32 ObjectIdx, const FString& VarName) const;
+	const FString* FindStr(const int32 ObjectIdx, const FString& VarName) const;
+
+	/** Current value of a variable looked up by name, nullptr if the object or the variable doesn't exist */
+	const int32* FindInt(const FString& ObjectName, const FString& VarName) const;
+	const double* FindFloat(const FString& ObjectName, const FString& VarName) const;
+	const FString* FindStr(const FString& ObjectName, const FString& VarName) const;
+
+	/**
+	 *	Read a numeric variable the way integer conditions see it: an integer variable as it is, a float variable
+	 *	rounded down (and clamped into the integer range), with a flag telling whether anything has been cut off.
+	 *	An integer literal L then compares against the float F exactly: F < L iff Floor(F) < L, F == L iff
+	 *	Floor(F) == L without a fraction, and F > L iff Floor(F) > L or Floor(F) == L with a fraction. A variable
+	 *	without a numeric value falls back to ReadStrBool().
+	 *
+	 *	@param[in]	Ref				Resolved variable
+	 *	@param[out]	OutValue		Integer value, or the float rounded down
+	 *	@param[out]	bOutFraction	True if the variable is a float with a non-zero fractional part
+	 *	@return False if the variable has neither an integer, a float nor a boolean string value
+	 */
+	bool ReadWhole(const FDialogueVariableRef& Ref, int32& OutValue, bool& bOutFraction) const;
+
+	/**
+	 *	Read a string variable holding "true" or "false" (ignoring case) as 1 or 0, the way the "true"/"false" literals
+	 *	are compiled. Keeps such strings - set from Blueprints or saves - matching the boolean literals
+	 *
+	 *	@param[in]	Ref			Resolved variable
+	 *	@param[out]	OutValue	1 or 0
+	 *	@return False if the variable has no string value, or a different one
+	 */
+	bool ReadStrBool(const FDialogueVariableRef& Ref, int32& OutValue) const;
+
+	/**
+	 *	Write a variable, adding it if necessary. Writing an integer removes a float of the same name and vice versa,
+	 *	so that a numeric variable is only ever read from one lane
+	 *
+	 *	@param ObjectIdx	Index of the object owning the variable
+	 *	@param VarName		Name of the variable
+	 *	@param Value		New value
+	 *	@return True if the value has changed
+	 */
+	bool SetInt(const int32 ObjectIdx, const FString& VarName, const int32 Value);
+	bool SetFloat(const int32 ObjectIdx, const FString& VarName, const double Value);
+	bool SetStr(const int32 ObjectIdx, const FString& VarName, const FString& Value);
+
+	/** Write a string variable from a name, e.g. an FName, an enumerator or a gameplay tag. NAME_None is an empty string */
+	bool SetName(const int32 ObjectIdx, const FString& VarName, const FName Value);
+
+	/**
+	 *	Remove a variable. Its slot stays interned
+	 *
+	 *	@param ObjectIdx	Index of the object owning the variable
+	 *	@param VarName		Name of the variable
+	 *	@return True if the variable existed
+	 */
+	bool RemoveInt(const int32 ObjectIdx, const FString& VarName);
+	bool RemoveFloat(const int32 ObjectIdx, const FString& VarName);
+	bool RemoveStr(const int32 ObjectIdx, const FString& VarName);
+
+	/** Call Func(const FString& VarName, int32 Value) for every integer variable of an object */
+	template<typename FuncType>
+	void ForEachInt(const int32 ObjectIdx, FuncType&& Func) const
+	{
+		for (const TPair<FString, int32>& Slot : Objects[ObjectIdx].IntSlots)
+		{
+			if (IntPresent.Test(Slot.Value))
+				Func(Slot.Key, IntValues[Slot.Value]);
+		}
+	}
+
+	/** Call Func(const FString& VarName, double Value) for every float variable of an object */
+	template<typename FuncType>
+	void ForEachFloat(const int32 ObjectIdx, FuncType&& Func) const
+	{
+		for (const TPair<FString, int32>& Slot : Objects[ObjectIdx].FloatSlots)
+		{
+			if (FloatPresent.Test(Slot.Value))
+				Func(Slot.Key, FloatValues[Slot.Value]);
+		}
+	}
+
+	/** Call Func(const FString& VarName, const FString& Value) for every string variable of an object */
+	template<typename FuncType>
+	void ForEachStr(const int32 ObjectIdx, FuncType&& Func) const
+	{
+		for (const TPair<FString, int32>& Slot : Objects[ObjectIdx].StrSlots)
+		{
+			if (StrPresent.Test(Slot.Value))
+				Func(Slot.Key, StrValues[Slot.Value]);
+		}
+	}
+
+	/** Version of the whole store, advanced by every change (including new slots reserved by BindVariable()) */
+	FORCEINLINE uint64 GetVersion() const { return Version; }
+
+	/** Version at which a slot has last changed */
+	FORCEINLINE uint64 GetIntSlotVersion(const int32 Slot) const { return IntVersions[Slot]; }
+	FORCEINLINE uint64 GetFloatSlotVersion(const int32 Slot) const { return FloatVersions[Slot]; }
+	FORCEINLINE uint64 GetStrSlotVersion(const int32 Slot) const { return StrVersions[Slot]; }
+
+	/**
+	 *	Copy an object into the mapping the Blueprint API and the World State listeners work with
+	 *
+	 *	@param[in]	ObjectIdx	Index of the object
+	 *	@param[out]	OutMapping	Overwritten with the object's current state
+	 */
+	void ExportObject(const int32 ObjectIdx, FObjectValueMapping& OutMapping) const;
+
+private:
+	/** Object name -> index into Objects */
+	TMap<FString, int32> ObjectIds;
+	TArray<FStoreObject> Objects;
+
+	/** Integer slots */
+	TArray<int32> IntValues;
+	TArray<uint64> IntVersions;
+	FDialogueBitSet IntPresent;
+
+	/** Float slots, double precision so that Blueprint floats (doubles since UE5) compare exactly */
+	TArray<double> FloatValues;
+	TArray<uint64> FloatVersions;
+	FDialogueBitSet FloatPresent;
+
+	/** String slots, with the id of every value next to the value itself */
+	TArray<FString> StrValues;
+	TArray<int32> StrIds;
+	TArray<uint64> StrVersions;
+	FDialogueBitSet StrPresent;
+
+	/** String ids, ignoring case. Id N lives at index N - 1, EmptyStrId is never stored */
+	TMap<FString, int32> StrIdLookup;
+	TArray<FString> StrIdValues;
+	TArray<int32> StrIdRefs;
+	TArray<int32> FreeStrIds;
+
+	uint64 Version = 0;
+
+	/** Id of a string, adding a reference to it (and interning it if it is new) */
+	int32 AcquireStrId(const FString& Value);
+
+	/** Drop a reference to a string id, freeing it once nothing holds it anymore */
+	void ReleaseStrId(const int32 Id);
+
+	/** Advance the version and stamp it on an object, returns the new version */
+	uint64 Stamp(const int32 ObjectIdx);
+
+	/** Slot of a variable, interning it (with no value) if it is new */
+	int32 FindOrAddIntSlot(const int32 ObjectIdx, const FString& VarName);
+	int32 FindOrAddFloatSlot(const int32 ObjectIdx, const FString& VarName);
+	int32 FindOrAddStrSlot(const int32 ObjectIdx, const FString& VarName);
+
+	/** Index of an object, reserving it (not live) if it doesn't exist */
+	int32 FindOrReserveObject(const FString& ObjectName);
+};
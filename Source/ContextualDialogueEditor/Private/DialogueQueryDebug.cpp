@@ -23,22 +23,38 @@ void UDialogueQueryDebug::NativeConstruct()
 	FEditorDelegates::PostPIEStarted.AddUFunction(this, FName("PIEStarted"));
 }
 
-void UDialogueQueryDebug::OnDialogueQueryFinished(TArray<FLineScore> Scores, TArray<UContextualDialogueLine*> Lines)
+void UDialogueQueryDebug::OnDialogueQueryFinished(TArray<FLineScore> Scores, TArray<UContextualDialogueLine*> Lines, TArray<FDialogueLineMatchCapture> Matches)
 {
 	UE_LOG(DialogueQueryDebug, Warning, TEXT("WIDGET RECEIVED QUERY UPDATE. Num lines : %i ; Num scores: %i"), Lines.Num(), Scores.Num());
 
-	// Parallel sort two arrays - in order to get the lines in ascending sort order
-	FArrayUtils::SortArray(Scores, [&Scores, &Lines](const int32 Index1, const int32 Index2) {
+	// Parallel sort three arrays - in order to get the lines in ascending sort order
+	FArrayUtils::SortArray(Scores, [&Scores, &Lines, &Matches](const int32 Index1, const int32 Index2) {
 		Scores.SwapMemory(Index2, Index1);
 		Lines.SwapMemory(Index2, Index1);
+		Matches.SwapMemory(Index2, Index1);
 	});
 
 	// Revert the arrays to actually get them in descending orer
 	Algo::Reverse(Lines);
 	Algo::Reverse(Scores);
+	Algo::Reverse(Matches);
+
+	// The queries don't touch the lines anymore, so copy the captured matches over for the widget to highlight
+	for (int32 LineIdx = 0; LineIdx < Lines.Num() && LineIdx < Matches.Num(); LineIdx++)
+	{
+		UContextualDialogueLine* Line = Lines[LineIdx];
+		const FDialogueLineMatchCapture& LineMatches = Matches[LineIdx];
+
+		for (int32 CondIdx = 0; CondIdx < Line->Conditions.Num() && CondIdx < LineMatches.ConditionsMatched.Num(); CondIdx++)
+			Line->Conditions[CondIdx].IsMatched = LineMatches.ConditionsMatched[CondIdx];
+
+		for (int32 CondIdx = 0; CondIdx < Line->Filters.Num() && CondIdx < LineMatches.FiltersMatched.Num(); CondIdx++)
+			Line->Filters[CondIdx].IsMatched = LineMatches.FiltersMatched[CondIdx];
+	}
 	
 	m_CurrentLines = Lines;
 	m_CurrentScores = Scores;
+	m_CurrentMatches = Matches;
 
 	// Rebuilt the widget with new information
 	RebuildDebugWidget();
@@ -29,9 +29,10 @@ public:
 	 *
 	 *  @param Scores	The scores that have been awarded to dialogue lines by the DialogueManagerSubsystem
 	 *  @param Lines	The array of all lines that have been returned from the query
+	 *  @param Matches	Which conditions and filters of each line were fulfilled, in the same order as Lines
 	 */
 	UFUNCTION()
-	void OnDialogueQueryFinished( TArray<FLineScore> Scores, TArray<UContextualDialogueLine*> Lines);
+	void OnDialogueQueryFinished( TArray<FLineScore> Scores, TArray<UContextualDialogueLine*> Lines, TArray<FDialogueLineMatchCapture> Matches);
 
 	/**
 	 *  A function to be subscribed to the PIEStarted event dispatcher of the editor. We need to get a reference to the Dialogue
@@ -55,4 +56,7 @@ protected:
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Dialogue Debug Data")
 	TArray<FLineScore> m_CurrentScores;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Dialogue Debug Data")
+	TArray<FDialogueLineMatchCapture> m_CurrentMatches;
 };